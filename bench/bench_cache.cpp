@@ -0,0 +1,67 @@
+// Batch runs over a file of quizzes without, into and from a result cache
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include "cache.hpp"
+#include "exam.hpp"
+
+namespace {
+
+    void write_quizzes(const std::filesystem::path &path, const size_t n,
+                       const double changed) {
+        std::mt19937 gen(39);
+        std::mt19937 gen_changed(40);
+        std::uniform_real_distribution<> coin(0.0, 1.0);
+        const exam::Generator g("+, -, *, /, ^, !, ln", 6, 2, 9);
+        std::ofstream ofs(path);
+        for (size_t i = 0; i < n; ++i) {
+            const std::string s = g.Expr(gen);
+            ofs << (coin(gen_changed) < changed ? s + " + 1" : s) << "\n";
+        }
+    }
+
+    void time_run(const char *name, const std::filesystem::path &src,
+                  const std::filesystem::path *cache_path) {
+        std::ofstream null("/dev/null");
+        const auto t0 = std::chrono::steady_clock::now();
+        cache::Stats st;
+        if (cache_path == nullptr) {
+            cache::run(src, nullptr, null);
+        } else {
+            cache::Store store(*cache_path);
+            cache::run(src, &store, null);
+            st = store.Usage();
+        }
+        const std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        std::printf("  %-22s %8.1f ms  hit rate %5.1f%%\n", name,
+                    dt.count() * 1e3, st.HitRate() * 100);
+    }
+
+} // namespace
+
+void bench_cache() {
+    static constexpr size_t kN = 1000000;
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto src = dir / "scicalc_bench_batch.txt";
+    const auto path = dir / "scicalc_bench.cache";
+    std::filesystem::remove(path);
+
+    write_quizzes(src, kN, 0);
+    std::printf("%zu lines, %ju bytes\n", kN,
+                static_cast<uintmax_t>(std::filesystem::file_size(src)));
+    time_run("no cache", src, nullptr);
+    time_run("cold cache", src, &path);
+    time_run("warm cache", src, &path);
+    write_quizzes(src, kN, 0.03);
+    time_run("warm, 3% changed", src, &path);
+    std::printf("  cache file %ju bytes\n",
+                static_cast<uintmax_t>(std::filesystem::file_size(path)));
+
+    std::filesystem::remove(src);
+    std::filesystem::remove(path);
+}
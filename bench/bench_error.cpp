@@ -0,0 +1,123 @@
+// Throwing vs expected-based error API on mixed-validity corpora, and the
+// cost of evaluating under a budget
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "exam.hpp"
+#include "prog.hpp"
+
+namespace {
+
+    // `n` quizzes of which a fraction `bad` is corrupted by one random edit
+    std::vector<std::string> corpus_mixed(const size_t n, const double bad,
+                                          const unsigned seed) {
+        static constexpr char kJunk[] = "+*()x";
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<> coin(0.0, 1.0);
+        std::vector<std::string> out;
+        out.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            // no division or unary ops: valid quizzes stay finite
+            std::string s = exam::rand_expr("+, -, *", 4, 2, 9);
+            if (coin(gen) < bad) {
+                const size_t pos = gen() % s.size();
+                s[pos] = kJunk[gen() % (sizeof(kJunk) - 1)];
+            }
+            out.push_back(std::move(s));
+        }
+        return out;
+    }
+
+    template <typename F>
+    void report(const char *name, const std::vector<std::string> &corpus,
+                F &&fn) {
+        size_t n_err = 0;
+        float sum = 0;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (const auto &s : corpus)
+            fn(s.c_str(), sum, n_err);
+        const std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        std::printf("  %-22s %8.1f ns/expr %10.0f expr/s  errors %zu\n", name,
+                    dt.count() * 1e9 / corpus.size(), corpus.size() / dt.count(),
+                    n_err);
+        if (sum == 12345.0f)
+            std::printf(" ");
+    }
+
+} // namespace
+
+void bench_error() {
+    static constexpr size_t kN = 200000;
+    // every limit set, so that every check runs
+    std::atomic<bool> cancel{false};
+    expr::Budget budget;
+    budget.max_len = 1 << 16;
+    budget.max_tokens = 1 << 14;
+    budget.max_depth = 24;
+    budget.max_steps = 1 << 13;
+    budget.cancel = &cancel;
+    budget.deadline = expr::Budget::Clock::now() + std::chrono::hours(1);
+    for (const double bad : {0.0, 0.05, 0.10, 0.50}) {
+        const auto corpus = corpus_mixed(kN, bad, 42);
+        std::printf("invalid %.0f%%\n", bad * 100);
+        report("expr::eval (throw)", corpus,
+               [](const char *s, float &sum, size_t &n_err) {
+                   try {
+                       sum += expr::eval(s);
+                   } catch (const std::exception &) {
+                       ++n_err;
+                   }
+               });
+        report("prog::eval (throw)", corpus,
+               [](const char *s, float &sum, size_t &n_err) {
+                   try {
+                       sum += prog::eval(s);
+                   } catch (const std::exception &) {
+                       ++n_err;
+                   }
+               });
+        report("prog::try_eval", corpus,
+               [](const char *s, float &sum, size_t &n_err) {
+                   const auto r = prog::try_eval(s);
+                   if (r)
+                       sum += r.value();
+                   else
+                       ++n_err;
+               });
+        report("prog::try_eval budget", corpus,
+               [&](const char *s, float &sum, size_t &n_err) {
+                   const auto r = prog::try_eval(s, nullptr, &budget);
+                   if (r)
+                       sum += r.value();
+                   else
+                       ++n_err;
+               });
+    }
+
+    // a hostile 16 MB request is turned down after `max_len` bytes
+    std::string huge = "1";
+    while (huge.size() < (size_t(1) << 24))
+        huge += " + 1";
+    std::printf("16 MB input\n");
+    report("prog::try_eval", {huge},
+           [](const char *s, float &sum, size_t &n_err) {
+               const auto r = prog::try_eval(s);
+               if (r)
+                   sum += r.value();
+               else
+                   ++n_err;
+           });
+    report("prog::try_eval budget", {huge},
+           [&](const char *s, float &sum, size_t &n_err) {
+               const auto r = prog::try_eval(s, nullptr, &budget);
+               if (r)
+                   sum += r.value();
+               else
+                   ++n_err;
+           });
+}
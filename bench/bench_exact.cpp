@@ -0,0 +1,56 @@
+// Exact integer evaluation vs float evaluation of integer quizzes
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "exact.hpp"
+#include "exam.hpp"
+#include "prog.hpp"
+
+namespace {
+
+    void bench_exact_ops(const char *ops) {
+        static constexpr size_t kN = 200000;
+        std::mt19937 gen(30);
+        const exam::Generator g(ops, 4, 2, 9);
+        std::vector<prog::Program> progs;
+        progs.reserve(kN);
+        for (size_t i = 0; i < kN; ++i)
+            progs.push_back(prog::compile(g.Expr(gen).c_str()));
+
+        std::vector<float> f(kN);
+        std::vector<exact::Value> x(kN);
+        const auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kN; ++i)
+            f[i] = prog::run(progs[i].view());
+        const auto t1 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kN; ++i)
+            x[i] = exact::run(progs[i].view());
+        const auto t2 = std::chrono::steady_clock::now();
+
+        size_t n_exact = 0;
+        size_t n_diff = 0;
+        for (size_t i = 0; i < kN; ++i) {
+            n_exact += x[i].IsExact();
+            // float answers that are not the correctly rounded exact one
+            n_diff += x[i].IsExact() && f[i] != x[i].ToFloat();
+        }
+        const std::chrono::duration<double> df = t1 - t0;
+        const std::chrono::duration<double> dx = t2 - t1;
+        std::printf("%s\n", ops);
+        std::printf("  %-12s %8.1f ns/expr\n", "prog::run",
+                    df.count() * 1e9 / kN);
+        std::printf("  %-12s %8.1f ns/expr\n", "exact::run",
+                    dx.count() * 1e9 / kN);
+        std::printf("  exact %zu / %zu, float answer off in %zu\n", n_exact,
+                    kN, n_diff);
+    }
+
+} // namespace
+
+void bench_exact() {
+    bench_exact_ops("+, -, *");
+    bench_exact_ops("+, -, *, /");
+    bench_exact_ops("+, -, *, ^, !");
+}
@@ -0,0 +1,41 @@
+// Micro-benchmarks, run all or only the ones named on the command line
+#include <cstring>
+#include <iostream>
+
+#include "bench_cache.cpp"
+#include "bench_error.cpp"
+#include "bench_exact.cpp"
+#include "bench_memo.cpp"
+#include "bench_par.cpp"
+#include "bench_shm.cpp"
+#include "bench_stream.cpp"
+#include "bench_vmath.cpp"
+
+struct Bench {
+    const char *name;
+    void (*fn)();
+};
+
+static constexpr Bench kBenches[] = {
+    {"cache", bench_cache},
+    {"error", bench_error},
+    {"exact", bench_exact},
+    {"memo", bench_memo},
+    {"par", bench_par},
+    {"shm", bench_shm},
+    {"stream", bench_stream},
+    {"vmath", bench_vmath},
+};
+
+int main(int argc, char **argv) {
+    for (const auto &b : kBenches) {
+        bool run = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            run = run || std::strcmp(argv[i], b.name) == 0;
+        if (!run)
+            continue;
+        std::cout << "== " << b.name << " ==" << std::endl;
+        b.fn();
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+// Batch evaluation with and without memoizing repeated subexpressions
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "exam.hpp"
+#include "memo.hpp"
+#include "prog.hpp"
+
+namespace {
+
+    void bench_memo_ops(const char *ops, const int max_opd) {
+        static constexpr size_t kN = 200000;
+        std::mt19937 gen(34);
+        const exam::Generator g(ops, 4, 2, max_opd);
+        std::vector<prog::Program> progs;
+        progs.reserve(kN);
+        for (size_t i = 0; i < kN; ++i)
+            progs.push_back(prog::compile(g.Expr(gen).c_str()));
+        std::vector<prog::View> views;
+        for (const auto &p : progs)
+            views.push_back(p.view());
+
+        std::vector<float> a(kN);
+        std::vector<float> b(kN);
+        memo::Table t;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kN; ++i)
+            a[i] = prog::run(views[i]);
+        const auto t1 = std::chrono::steady_clock::now();
+        memo::run_batch(views, b.data(), t);
+        const auto t2 = std::chrono::steady_clock::now();
+
+        const std::chrono::duration<double> d_run = t1 - t0;
+        const std::chrono::duration<double> d_memo = t2 - t1;
+        const memo::Stats &st = t.Usage();
+        std::printf("%s in [2, %d]: run %.1f ms, memo %.1f ms, %zu lookups, "
+                    "hit rate %.1f%%\n",
+                    ops, max_opd, d_run.count() * 1e3, d_memo.count() * 1e3,
+                    static_cast<size_t>(st.lookups), st.HitRate() * 100);
+    }
+
+} // namespace
+
+void bench_memo() {
+    bench_memo_ops("+, -, *, /", 9);
+    bench_memo_ops("+, -, *, /, ^, !, ln", 9);
+    bench_memo_ops("+, -, *, /, ^, !, ln", 5);
+    bench_memo_ops("^, !, ln", 5);
+}
@@ -0,0 +1,77 @@
+// Serial vs parallel evaluation of one million-term expression
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "exam.hpp"
+#include "par.hpp"
+#include "pool.hpp"
+#include "prog.hpp"
+
+namespace {
+
+    // quizzes of 4 operands joined by `ops`, 1M operands in total
+    std::string huge_expr(const char *quiz_ops, const char *ops) {
+        static constexpr int kNQuiz = 250000;
+        std::mt19937 gen(32);
+        const exam::Generator g(quiz_ops, 4, 2, 9);
+        std::uniform_int_distribution<size_t> pick(0, std::strlen(ops) - 1);
+        std::string str;
+        for (int i = 0; i < kNQuiz; ++i) {
+            if (i > 0) {
+                str += ' ';
+                str += ops[pick(gen)];
+                str += ' ';
+            }
+            str += '(';
+            str += g.Expr(gen);
+            str += ')';
+        }
+        return str;
+    }
+
+    template <typename Fn> double secs(Fn &&fn) {
+        static constexpr int kRep = 5;
+        double best = 1e30;
+        for (int r = 0; r < kRep; ++r) {
+            const auto t0 = std::chrono::steady_clock::now();
+            fn();
+            const std::chrono::duration<double> d =
+                std::chrono::steady_clock::now() - t0;
+            best = std::min(best, d.count());
+        }
+        return best;
+    }
+
+    void bench_par_expr(const char *quiz_ops, const char *ops) {
+        const std::string str = huge_expr(quiz_ops, ops);
+        par::Options opt;
+        opt.threshold = 0;
+        float serial = 0;
+        float exact = 0;
+        float reassoc = 0;
+        const double ds = secs(
+            [&] { serial = prog::try_eval(str.c_str()).value_or(0); });
+        const double dp = secs([&] { exact = par::eval(str.c_str(), opt); });
+        opt.reassociate = true;
+        const double dr = secs([&] { reassoc = par::eval(str.c_str(), opt); });
+        std::printf("%s joined by %s, %zu bytes\n", quiz_ops, ops, str.size());
+        std::printf("  %-18s %8.2f ms  %g\n", "prog::try_eval", ds * 1e3,
+                    serial);
+        std::printf("  %-18s %8.2f ms  %g\n", "par::eval", dp * 1e3, exact);
+        std::printf("  %-18s %8.2f ms  %g\n", "par::eval reassoc", dr * 1e3,
+                    reassoc);
+    }
+
+} // namespace
+
+void bench_par() {
+    std::printf("pool threads: %u\n", pool::shared().Size());
+    bench_par_expr("+, -, *", "+-");
+    bench_par_expr("+, -, *, /", "*/");
+    bench_par_expr("*", "*");
+    bench_par_expr("+, -, *, /, ^, !, ln", "+-*/");
+}
@@ -0,0 +1,132 @@
+// Round trips through the shared-memory rings vs a pair of pipes
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "exam.hpp"
+#include "prog.hpp"
+#include "shm.hpp"
+
+namespace {
+
+    static constexpr size_t kPingPongs = 20000;
+    static constexpr size_t kPipelined = 200000;
+    // requests in flight when pipelining, small enough for a pipe buffer
+    static constexpr size_t kWindow = 256;
+
+    // One transport seen from the client: send a request, receive the next
+    // response, stop the server
+    struct Client {
+        std::function<void(uint64_t, const std::string &)> send;
+        std::function<void(shm::Response &)> recv;
+        std::function<void()> close;
+    };
+
+    void report(const char *name, const Client &c,
+                const std::vector<std::string> &exprs) {
+        using clock = std::chrono::steady_clock;
+        shm::Response r;
+        std::vector<double> lat(kPingPongs);
+        for (size_t i = 0; i < kPingPongs; ++i) {
+            const auto t0 = clock::now();
+            c.send(i, exprs[i % exprs.size()]);
+            c.recv(r);
+            lat[i] = std::chrono::duration<double>(clock::now() - t0).count();
+        }
+        std::sort(lat.begin(), lat.end());
+        const auto pct = [&](const double p) {
+            return lat[static_cast<size_t>(p * (lat.size() - 1))] * 1e6;
+        };
+
+        const auto t0 = clock::now();
+        size_t sent = 0;
+        for (size_t i = 0; i < kPipelined; ++i) {
+            for (; sent < kPipelined && sent < i + kWindow; ++sent)
+                c.send(sent, exprs[sent % exprs.size()]);
+            c.recv(r);
+        }
+        const std::chrono::duration<double> d = clock::now() - t0;
+        c.close();
+        std::printf("  %-12s p50 %6.2f us  p99 %7.2f us  p99.9 %7.2f us  "
+                    "%9.0f msgs/s\n",
+                    name, pct(0.5), pct(0.99), pct(0.999),
+                    kPipelined / d.count());
+    }
+
+    void bench_shm_wait(const char *name, const shm::Wait w,
+                        const std::vector<std::string> &exprs) {
+        const std::string path = "/scicalc_bench_" + std::to_string(getpid());
+        shm::Channel server = shm::Channel::Create(path);
+        std::thread t([&] { server.Serve(w); });
+        shm::Channel client = shm::Channel::Open(path);
+        report(name,
+               {[&](uint64_t tag, const std::string &s) {
+                    client.Send(tag, s, w);
+                },
+                [&](shm::Response &r) { client.Recv(r, w); },
+                [&] { client.Close(); }},
+               exprs);
+        t.join();
+    }
+
+    // The same protocol over pipes: fixed-size frames, a system call per
+    // message and a copy in and out of the kernel
+    void bench_pipe(const std::vector<std::string> &exprs) {
+        int req[2], resp[2];
+        if (pipe(req) != 0 || pipe(resp) != 0)
+            return;
+        std::thread t([&] {
+            shm::Request rq;
+            while (read(req[0], &rq, sizeof(rq)) == sizeof(rq)) {
+                const auto v = prog::try_eval(rq.text);
+                shm::Response rs{};
+                rs.tag = rq.tag;
+                rs.value = v.value_or(0);
+                rs.code = v ? expr::Errc::OK : v.error().code;
+                if (write(resp[1], &rs, sizeof(rs)) != sizeof(rs))
+                    break;
+            }
+            close(resp[1]);
+        });
+        report("pipe",
+               {[&](uint64_t tag, const std::string &s) {
+                    shm::Request rq{};
+                    rq.tag = tag;
+                    rq.len = static_cast<uint32_t>(s.size());
+                    std::memcpy(rq.text, s.c_str(), s.size() + 1);
+                    if (write(req[1], &rq, sizeof(rq)) != sizeof(rq))
+                        std::perror("write");
+                },
+                [&](shm::Response &r) {
+                    if (read(resp[0], &r, sizeof(r)) != sizeof(r))
+                        std::perror("read");
+                },
+                [&] { close(req[1]); }},
+               exprs);
+        t.join();
+        close(req[0]);
+        close(resp[0]);
+    }
+
+} // namespace
+
+void bench_shm() {
+    std::mt19937 gen(36);
+    const exam::Generator g("+, -, *, /, ^, !, ln", 4, 2, 9);
+    std::vector<std::string> exprs;
+    for (int i = 0; i < 4096; ++i)
+        exprs.push_back(g.Expr(gen));
+
+    std::printf("%zu round trips, then %zu pipelined %zu deep\n", kPingPongs,
+                kPipelined, kWindow);
+    bench_shm_wait("shm spin", shm::Wait::SPIN, exprs);
+    bench_shm_wait("shm futex", shm::Wait::FUTEX, exprs);
+    bench_pipe(exprs);
+}
@@ -0,0 +1,54 @@
+// Serial evaluation of a whole string vs streaming it in chunks
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "exam.hpp"
+#include "prog.hpp"
+#include "stream.hpp"
+
+namespace {
+
+    void bench_stream_chunk(const std::string &str, const size_t chunk) {
+        std::istringstream in(str);
+        const auto t0 = std::chrono::steady_clock::now();
+        const auto v = stream::try_eval(in, nullptr, chunk);
+        const std::chrono::duration<double> d =
+            std::chrono::steady_clock::now() - t0;
+        std::printf("  %-18s %8.2f ms  %g\n",
+                    ("stream " + std::to_string(chunk) + " B").c_str(),
+                    d.count() * 1e3, v.value_or(0));
+    }
+
+} // namespace
+
+void bench_stream() {
+    // 1M operands: quizzes of 4 operands joined by `+ -`
+    std::mt19937 gen(33);
+    const exam::Generator g("+, -, *, /, ^, !, ln", 4, 2, 9);
+    std::string str;
+    for (int i = 0; i < 250000; ++i) {
+        if (i > 0)
+            str += i % 2 == 0 ? " + " : " - ";
+        str += '(';
+        str += g.Expr(gen);
+        str += ')';
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const auto v = prog::try_eval(str.c_str());
+    const std::chrono::duration<double> d =
+        std::chrono::steady_clock::now() - t0;
+    std::printf("%zu bytes\n", str.size());
+    std::printf("  %-18s %8.2f ms  %g\n", "prog::try_eval", d.count() * 1e3,
+                v.value_or(0));
+    for (const size_t chunk : {size_t(4096), stream::kChunk})
+        bench_stream_chunk(str, chunk);
+
+    stream::Evaluator ev;
+    ev.Feed(str.data(), str.size());
+    ev.Finish();
+    std::printf("  peak: %zu operands and operators held\n", ev.Peak());
+}
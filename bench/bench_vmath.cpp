@@ -0,0 +1,74 @@
+// Array kernels per accuracy tier, and batch vs one-by-one program evaluation
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "exam.hpp"
+#include "prog.hpp"
+#include "vmath.hpp"
+
+namespace {
+
+    static constexpr const char *kTierNames[] = {"exact", "ulp1", "ulp4"};
+
+    template <typename F> double time_ns(const size_t n, F &&fn) {
+        const auto t0 = std::chrono::steady_clock::now();
+        fn();
+        const std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        return dt.count() * 1e9 / n;
+    }
+
+} // namespace
+
+void bench_vmath() {
+    static constexpr size_t kN = 1 << 20;
+    std::mt19937 gen(29);
+    std::uniform_real_distribution<float> dist(0.5f, 30.0f);
+    std::vector<float> x(kN), y(kN), out(kN);
+    for (size_t i = 0; i < kN; ++i) {
+        x[i] = dist(gen);
+        y[i] = dist(gen) - 15;
+    }
+
+    std::printf("kernels, %zu elements\n", kN);
+    for (const auto acc : {vmath::Accuracy::EXACT, vmath::Accuracy::ULP1,
+                           vmath::Accuracy::ULP4}) {
+        const double t_log =
+            time_ns(kN, [&] { vmath::log(x.data(), out.data(), kN, acc); });
+        const double t_pow = time_ns(
+            kN, [&] { vmath::pow(x.data(), y.data(), out.data(), kN, acc); });
+        const double t_gamma =
+            time_ns(kN, [&] { vmath::tgamma(x.data(), out.data(), kN, acc); });
+        std::printf("  %-6s log %6.2f  pow %6.2f  tgamma %6.2f ns/elem\n",
+                    kTierNames[static_cast<int>(acc)], t_log, t_pow, t_gamma);
+    }
+
+    // quizzes heavy in the expensive operators
+    static constexpr size_t kProgs = 100000;
+    const exam::Generator g("+, *, ^, !, ln", 5, 1, 5);
+    std::vector<prog::Program> progs;
+    std::vector<prog::View> views;
+    progs.reserve(kProgs);
+    for (size_t i = 0; i < kProgs; ++i)
+        progs.push_back(prog::compile(g.Expr(gen).c_str()));
+    for (const auto &p : progs)
+        views.push_back(p.view());
+
+    std::printf("programs, %zu quizzes\n", kProgs);
+    std::vector<float> res(kProgs);
+    const double t_run = time_ns(kProgs, [&] {
+        for (size_t i = 0; i < kProgs; ++i)
+            res[i] = prog::run(views[i]);
+    });
+    std::printf("  %-12s %8.1f ns/expr\n", "run", t_run);
+    for (const auto acc : {vmath::Accuracy::EXACT, vmath::Accuracy::ULP1,
+                           vmath::Accuracy::ULP4}) {
+        const double t = time_ns(
+            kProgs, [&] { prog::run_batch(views, res.data(), acc); });
+        std::printf("  batch %-6s %8.1f ns/expr\n",
+                    kTierNames[static_cast<int>(acc)], t);
+    }
+}
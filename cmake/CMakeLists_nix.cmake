@@ -18,11 +18,13 @@ find_package(Threads REQUIRED)
 set(MAIN_ALL_LIBS
     c
     dl
+    rt
     Threads::Threads
 )
 set(TEST_ALL_LIBS
     c
     dl
+    rt
     Threads::Threads
     gtest
     gtest_main
@@ -44,6 +46,26 @@ target_include_directories(${TEST_BIN_NAME} PRIVATE
     "${SciCalc_BINARY_DIR}/include" # Ensures config.h can be found
 )
 
+target_include_directories(${BENCH_BIN_NAME} PRIVATE
+    "${SciCalc_SOURCE_DIR}/include"
+    "${SciCalc_BINARY_DIR}/include" # Ensures config.h can be found
+)
+
+target_include_directories(${CODEGEN_BIN_NAME} PRIVATE
+    "${SciCalc_SOURCE_DIR}/include"
+    "${SciCalc_BINARY_DIR}/include" # Ensures config.h can be found
+)
+
+target_include_directories(${DIFF_BIN_NAME} PRIVATE
+    "${SciCalc_SOURCE_DIR}/include"
+    "${SciCalc_BINARY_DIR}/include" # Ensures config.h can be found
+)
+
+target_include_directories(${SHM_CLIENT_BIN_NAME} PRIVATE
+    "${SciCalc_SOURCE_DIR}/include"
+    "${SciCalc_BINARY_DIR}/include" # Ensures config.h can be found
+)
+
 target_compile_definitions(${TEST_BIN_NAME} PRIVATE
     -DGTEST_ACCESS
 )
@@ -51,3 +73,7 @@ target_compile_definitions(${TEST_BIN_NAME} PRIVATE
 # Link libraries
 target_link_libraries(${OUT_BIN_NAME} PRIVATE ${MAIN_ALL_LIBS})
 target_link_libraries(${TEST_BIN_NAME} PRIVATE ${TEST_ALL_LIBS})
+target_link_libraries(${BENCH_BIN_NAME} PRIVATE ${MAIN_ALL_LIBS})
+target_link_libraries(${CODEGEN_BIN_NAME} PRIVATE ${MAIN_ALL_LIBS})
+target_link_libraries(${SHM_CLIENT_BIN_NAME} PRIVATE ${MAIN_ALL_LIBS})
+target_link_libraries(${DIFF_BIN_NAME} PRIVATE ${MAIN_ALL_LIBS})
@@ -0,0 +1,30 @@
+# scicalc_add_formulas(<target> <formulas> [NAMESPACE <ns>])
+#
+# Compile a formula file into `<name>.hpp` with scicalc_codegen at build time
+# and let <target> include it, e.g. with `#include "physics.hpp"` for
+# `physics.txt`. The functions are in namespace <ns>, by default <name>.
+# <target> is built with -ffp-contract=off under GCC so that the functions
+# round every operation as `prog::run` does.
+function(scicalc_add_formulas target formulas)
+    cmake_parse_arguments(ARG "" "NAMESPACE" "" ${ARGN})
+    get_filename_component(src "${formulas}" ABSOLUTE)
+    get_filename_component(name "${formulas}" NAME_WE)
+    if(NOT ARG_NAMESPACE)
+        set(ARG_NAMESPACE "${name}")
+    endif()
+
+    set(dir "${CMAKE_CURRENT_BINARY_DIR}/${target}_formulas")
+    set(out "${dir}/${name}.hpp")
+    add_custom_command(
+        OUTPUT "${out}"
+        COMMAND "${CMAKE_COMMAND}" -E make_directory "${dir}"
+        COMMAND scicalc_codegen "${src}" "${out}" "${ARG_NAMESPACE}"
+        DEPENDS "${src}" scicalc_codegen
+        COMMENT "Generating ${name}.hpp from ${formulas}"
+        VERBATIM
+    )
+    target_sources(${target} PRIVATE "${out}")
+    target_include_directories(${target} PRIVATE "${dir}")
+    target_compile_options(${target} PRIVATE
+        $<$<CXX_COMPILER_ID:GNU>:-ffp-contract=off>)
+endfunction()
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "expr.hpp"
+#include "mapped.hpp"
+
+// Persistent, content-addressed cache of results for batch runs. Each
+// expression is normalized and hashed into a 128-bit key, which maps to its
+// value or error in an append-only file of fixed-size records:
+//
+//   Header | Record | Record | ...
+//
+// The file is memory-mapped when opened and indexed in memory, so a run
+// over lines that are all cached neither parses nor evaluates anything.
+// New results are appended when flushed; compaction rewrites the file with
+// one record per key, keeping the keys used by the current run first, and
+// runs whenever the file grows past its size limit. It keeps half of what
+// the limit allows, so the file then grows for a while before the next one.
+//
+// Keys are not cryptographic: two different expressions share a key with
+// probability about n^2 / 2^129 for n entries. Losing entries is harmless,
+// so nothing is synced to disk; with several writers at a time, the
+// entries of one may be lost but the file stays valid
+namespace cache {
+
+    inline constexpr char kMagic[4] = {'S', 'C', 'R', 'C'};
+    // bumped whenever the format or the result of any expression changes,
+    // which discards the entries of older versions
+    inline constexpr uint16_t kVersion = 2;
+    // written in native order, reads back as 0x0201 on a foreign host
+    inline constexpr uint16_t kEndian = 0x0102;
+    // default size limit of the file, 256 MiB or 8M records
+    inline constexpr size_t kMaxBytes = size_t(256) << 20;
+
+    struct Key {
+        uint64_t lo;
+        uint64_t hi;
+
+        bool operator==(const Key &) const = default;
+    };
+
+    struct Header {
+        char magic[4];
+        uint16_t version;
+        uint16_t endian;
+        char padding[8];
+    };
+    static_assert(sizeof(Header) == 16);
+
+    struct Record {
+        Key key;
+        float value;
+        uint32_t offset; // of the error, if any, in the normalized text
+        expr::Errc code; // `Errc::OK` on success
+        char padding[3];
+        uint32_t check; // over the bytes above, detects torn appends
+    };
+    static_assert(sizeof(Record) == 32);
+
+    struct Stats {
+        uint64_t lookups = 0;
+        uint64_t hits = 0;
+        uint64_t inserts = 0;
+        uint64_t compactions = 0;
+
+        double HitRate() const {
+            return lookups == 0 ? 0 : static_cast<double>(hits) / lookups;
+        }
+    };
+
+    // `line` with every run of blanks turned into one space and leading and
+    // trailing blanks dropped, into `out`. Lexes exactly like `line`, only
+    // with other error offsets
+    void normalize(std::string_view line, std::string &out);
+
+    std::string normalize(std::string_view line);
+
+    Key key(std::string_view text);
+
+    class Store {
+      public:
+        // Open the cache at `path`, creating it if needed. A file of another
+        // version or byte order is started over, and a torn record at the
+        // end, left by a crashed writer, is cut off. Throws
+        // `std::runtime_error` if the file cannot be opened or written
+        explicit Store(const std::string &path, size_t max_bytes = kMaxBytes);
+        // Flushes, ignoring errors
+        ~Store();
+
+        Store(const Store &) = delete;
+        Store &operator=(const Store &) = delete;
+
+        std::optional<expr::Expected<float>> Find(const Key &k);
+
+        // Hint that `n` keys are about to be looked up, so that their cache
+        // misses overlap rather than follow one another
+        void Prefetch(const Key *keys, size_t n) const;
+
+        void Insert(const Key &k, const expr::Expected<float> &r);
+
+        // Append the new records, then compact if over the size limit
+        void Flush();
+
+        // Rewrite the file with one record per key, the keys used since
+        // opening first, up to half the size limit
+        void Compact();
+
+        // Number of distinct keys
+        size_t Size() const { return n_keys_; }
+        size_t Bytes() const;
+        const Stats &Usage() const { return stats_; }
+
+      private:
+        void Open();
+        const Record &At(uint32_t i) const;
+        uint32_t *Slot(const Key &k);
+        void Index(uint32_t i);
+        void Reindex();
+
+        std::string path_;
+        size_t max_bytes_;
+        int fd_ = -1;
+        mapped::File file_;
+        const Record *mapped_ = nullptr;
+        uint32_t n_mapped_ = 0;
+        std::vector<Record> added_; // since opening
+        size_t n_flushed_ = 0;      // of `added_`, already in the file
+        std::vector<uint8_t> used_; // per record, mapped then added
+        // open addressing over record numbers + 1, 0 if empty
+        std::vector<uint32_t> index_;
+        size_t n_keys_ = 0;
+        Stats stats_;
+    };
+
+    // `prog::try_eval` of the normalized `text`, looked up in `store` first
+    expr::Expected<float> eval(Store &store, const std::string &text);
+
+    // Same, with `key(text)` already computed
+    expr::Expected<float> eval(Store &store, const std::string &text,
+                               const Key &k);
+
+    // Evaluate a text file of expressions, one per line, through `store`
+    // if any; empty lines and lines starting with '#' are skipped. Prints
+    // `<normalized line> = <value>` or the error and its column
+    void run(const std::string &path, Store *store, std::ostream &out);
+} // namespace cache
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "prog.hpp"
+
+// Ahead-of-time compilation of formulas into C++. A formula file has one
+// `name(a, b) = expr` per line (`name = expr` without variables); `#` starts
+// a comment line. Every formula becomes an inline function of its variables
+// with one `const float` per postfix instruction, computing the same value
+// as `prog::run` does with the variables bound to the arguments, provided
+// the includer does not contract `a * b + c` into an FMA (GCC needs
+// -ffp-contract=off)
+namespace codegen {
+
+    struct Formula {
+        std::string name;
+        std::vector<std::string> params;
+        std::string source; // the whole line
+        // variables are constants carrying `param_bits(i)`
+        prog::Program prog;
+    };
+
+    // Bits of the quiet NaN standing for variable `i` in `Formula::prog`
+    uint32_t param_bits(size_t i);
+
+    // Parse one formula line. Variable names follow `env::is_name`, and
+    // neither they nor the formula name may be C++ keywords. Throws
+    // `std::runtime_error` with the column of the error
+    Formula parse(const std::string &line);
+
+    // Parse every formula; throws naming the line of the first error or of
+    // a duplicate name
+    std::vector<Formula> read(std::istream &in);
+
+    // Write a header of inline functions in namespace `ns`
+    void emit(const std::vector<Formula> &formulas, const std::string &ns,
+              std::ostream &out);
+
+    // `read` + `emit`, only rewriting `out_path` if its content changes
+    void generate(const std::string &in_path, const std::string &out_path,
+                  const std::string &ns);
+} // namespace codegen
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Values bound by assignments, e.g. `x = 3! - ln 5`. The table is flat: names
+// and values sit in two arrays and an open-addressing index maps a name hash
+// to its position, so a lookup costs one hash and usually one compare
+namespace env {
+
+    // true if the lexer reads `name` as one identifier that is not a builtin.
+    // Builtins match exactly, so only the names of `expr::kIdents` are
+    // reserved and e.g. `lnx` or `pix` are valid
+    bool is_name(std::string_view name);
+
+    class Env {
+      public:
+        // Bind or rebind `name`, false if it is not a valid name
+        bool Set(std::string_view name, float v);
+
+        // nullptr if unbound; valid until the next `Set`
+        const float *Find(std::string_view name) const;
+
+        // Position of `name` for `Name` and `Value`, `Size()` if unbound
+        size_t Index(std::string_view name) const;
+
+        size_t Size() const { return names_.size(); }
+        const std::string &Name(size_t i) const { return names_[i]; }
+        float Value(size_t i) const { return values_[i]; }
+
+        void Clear();
+
+      private:
+        // slot of `name` in `index_`, empty if unbound
+        size_t Probe(std::string_view name, uint64_t hash) const;
+        void Grow();
+
+        std::vector<std::string> names_;
+        std::vector<float> values_;
+        std::vector<uint32_t> index_; // position + 1, 0 if empty
+    };
+} // namespace env
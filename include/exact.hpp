@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "env.hpp"
+#include "prog.hpp"
+
+// Exact evaluation of compiled programs: values stay int64 rationals while
+// every operation is exact and fits, and drop to float (through
+// `expr::kMapOp2Fn`) only when it does not, e.g. `ln 2`, `2^0.5` or `21!`
+namespace exact {
+
+    // Largest n with n! in int64
+    inline constexpr int64_t kMaxFct = 20;
+
+    // 16 bytes, so that values are passed and returned in registers
+    struct Value {
+        int64_t num = 0; // the float bits if inexact
+        int64_t den = 1; // > 0 and coprime with `num`; 0 if inexact
+
+        static Value Int(int64_t v) { return {v, 1}; }
+
+        // Exact if `v` is an integer within int64
+        static Value Real(float v);
+
+        bool IsExact() const { return den != 0; }
+
+        bool IsInt() const { return den == 1; }
+
+        float ToFloat() const;
+
+        // `num`, `num/den`, or the float
+        std::string ToStr() const;
+    };
+
+    // Bindings kept as values, so that e.g. `x = 2^40 + 1` stays exact.
+    // `Floats` binds the same names to `ToFloat()`, for the lexer
+    class Env {
+      public:
+        // Bind or rebind `name`, false if it is not a valid name
+        bool Set(std::string_view name, const Value &v);
+
+        // nullptr if unbound; valid until the next `Set`
+        const Value *Find(std::string_view name) const;
+
+        size_t Size() const { return values_.size(); }
+        const std::string &Name(size_t i) const { return floats_.Name(i); }
+        const Value &At(size_t i) const { return values_[i]; }
+
+        const env::Env &Floats() const { return floats_; }
+
+      private:
+        env::Env floats_;
+        std::vector<Value> values_; // by position in `floats_`
+    };
+
+    // Apply an operator (`expr::Sign`); `b` is ignored by unary operators
+    Value apply(uint8_t op, const Value &a, const Value &b);
+
+    // Constants are read from `v.pool`, so integers past 2^24 are already
+    // rounded; `eval` keeps literals exact
+    Value run(const prog::View &v);
+
+    // Same, with the constants read from `pool`, one per `v.pool` entry
+    Value run(const prog::View &v, const Value *pool);
+
+    // Integer literals and the names bound in `env` are pushed exact, not
+    // through the float pool. Non-throwing, as `prog::try_eval`
+    expr::Expected<Value> try_eval(const char *str, const Env *env = nullptr);
+
+    // Throwing version of `try_eval`
+    Value eval(const char *str, const Env *env = nullptr);
+} // namespace exact
@@ -1,8 +1,144 @@
 #pragma once
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <random>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "mapped.hpp"
 
 namespace exam {
+    // answers closer than this to the key are correct
+    inline constexpr float kEpsilon = 1e-3f;
+
     std::string rand_expr(const std::string &, const uint8_t, const int,
                           const int);
-}
+
+    struct Quiz {
+        std::string expr;
+        float ans;
+    };
+
+    // Quiz generator with the operator pools parsed once, drawing from a
+    // caller-owned engine so that bulk runs are reproducible and thread-safe
+    class Generator {
+      public:
+        Generator(const std::string &, const uint8_t, const int, const int);
+
+        std::string Expr(std::mt19937 &gen) const;
+
+        // Quiz with its answer key, redrawn while the answer is not finite.
+        // Throws `std::runtime_error` if no finite answer turns up after a
+        // bounded number of draws
+        Quiz Draw(std::mt19937 &gen) const;
+
+      private:
+        uint8_t n_opd_;
+        int min_opd_;
+        int max_opd_;
+        std::vector<char> ops_infix_;
+        std::vector<std::string (*)(const std::string &)> fns_opu_;
+        std::vector<std::string (*)(const std::string &)> fns_opu1_;
+    };
+
+    // default number of quizzes a `Session` draws ahead
+    inline constexpr size_t kSessionDepth = 8;
+
+    // Quizzes of one interactive exam, drawn on a background thread into a
+    // bounded queue while the earlier ones are answered, so that the first
+    // one is ready after a single draw however long the exam. Quizzes whose
+    // answer is not finite are redrawn there, off the interactive path
+    class Session {
+      public:
+        // `n` quizzes, at most `depth` of them waiting to be taken
+        Session(const Generator &g, size_t n, uint64_t seed,
+                size_t depth = kSessionDepth);
+        // Stops drawing, without waiting for the remaining quizzes
+        ~Session();
+
+        Session(const Session &) = delete;
+        Session &operator=(const Session &) = delete;
+
+        size_t Size() const { return n_; }
+
+        // Blocks until the next quiz is drawn. Throws `std::out_of_range`
+        // past the last one and `std::runtime_error` if no quiz with a
+        // finite answer could be drawn
+        Quiz Next();
+
+      private:
+        void Produce();
+
+        const Generator g_;
+        const size_t n_;
+        const size_t depth_;
+        std::mt19937 gen_; // used by the producer only
+        std::mutex mtx_;   // guards the fields below
+        std::condition_variable cv_ready_;
+        std::condition_variable cv_space_;
+        std::deque<Quiz> queue_;
+        size_t n_taken_ = 0;
+        bool stop_ = false;
+        std::string err_; // why the producer gave up, if it did
+        std::thread thread_;
+    };
+
+    // Exam sheet file: header | float key[n] | uint64 offsets[n + 1] | text,
+    // with n = n_exam * n_quiz and quiz `i` of exam `e` at `e * n_quiz + i`
+    inline constexpr char kSheetMagic[4] = {'S', 'C', 'X', 'M'};
+    inline constexpr uint16_t kSheetVersion = 1;
+    inline constexpr uint16_t kSheetEndian = 0x0102;
+
+    struct SheetHeader {
+        char magic[4];
+        uint16_t version;
+        uint16_t endian;
+        uint32_t n_exam;
+        uint32_t n_quiz;
+        uint64_t n_str; // bytes of quiz text
+    };
+    static_assert(sizeof(SheetHeader) == 24);
+
+    class Sheet {
+      public:
+        explicit Sheet(const std::string &path);
+
+        uint32_t NExam() const { return hdr_->n_exam; }
+        uint32_t NQuiz() const { return hdr_->n_quiz; }
+        size_t Size() const { return size_t(NExam()) * NQuiz(); }
+
+        float Key(size_t i) const { return key_[i]; }
+        std::string_view Expr(size_t i) const;
+
+        void Print(std::ostream &) const;
+
+      private:
+        mapped::File file_;
+        const SheetHeader *hdr_ = nullptr;
+        const float *key_ = nullptr;
+        const uint64_t *offsets_ = nullptr;
+        const char *str_ = nullptr;
+    };
+
+    struct Stats {
+        size_t n_quiz;
+        double secs;
+    };
+
+    // Generate `n_exam` exams of `n_quiz` quizzes and their answer keys in
+    // parallel into a sheet file. Throws `std::runtime_error` if a quiz with
+    // a finite answer cannot be drawn
+    Stats generate(const std::string &path, const Generator &,
+                   const uint32_t n_exam, const uint32_t n_quiz,
+                   const uint64_t seed);
+
+    // Grade an answer file against a sheet in parallel chunks of lines
+    Stats grade(const std::string &path_sheet, const std::string &path_ans,
+                const std::string &path_out);
+} // namespace exam
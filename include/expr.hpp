@@ -1,10 +1,99 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <variant>
 #include <vector>
 
+namespace env {
+    class Env;
+} // namespace env
+
 namespace expr {
 
+    // Error codes of the non-throwing API, one per message of the throwing one
+    enum class Errc : uint8_t {
+        OK = 0,
+        EMPTY_STRING,     // nothing but whitespace
+        EMPTY_EXPR,       // no operand at all e.g. `()`
+        UNKNOWN_OP,       // unknown single-character symbol
+        UNKNOWN_FN,       // unknown identifier
+        UNMATCHED_RPAR,   // `)` without `(`
+        UNMATCHED_LPAR,   // `(` without `)`
+        UNFINISHED_EXPR,  // ends with an infix / right associative operator
+        INCOMPLETE_EXPR,  // starts with an infix / left associative operator
+        DANGLING_NUM_OPL, // operand or `!` where an operator is expected
+        DANGLING_OPR_OPI, // operator where an operand is expected
+        RESERVED_NAME,    // assignment to a builtin or a non-identifier
+        IO_ERROR,         // the input could not be read
+        TOO_LONG,         // more bytes than `Budget::max_len`
+        TOO_MANY_TOKENS,  // more lexemes than `Budget::max_tokens`
+        TOO_DEEP,         // parentheses nested deeper than `Budget::max_depth`
+        TOO_MANY_STEPS,   // more operators applied than `Budget::max_steps`
+        CANCELLED,        // `Budget::cancel` was set
+        TIMED_OUT,        // `Budget::deadline` has passed
+        BAD_CALL,         // call without `(` or `,`, or `,` outside of one
+    };
+
+    struct Error {
+        Errc code = Errc::OK;
+        uint64_t offset = 0; // byte offset into the input
+        const char *msg = "";
+    };
+
+    // The message of `code`, as in `Error::msg` and the exceptions of the
+    // throwing API
+    const char *message(Errc code);
+
+    // Limits on one evaluation of untrusted input, none by default. The
+    // limits are checked as the input is consumed, so an oversized request
+    // fails after about `max_len` bytes of work; `cancel` and `deadline` are
+    // polled every `kBudgetPoll` lexemes or operators
+    struct Budget {
+        using Clock = std::chrono::steady_clock;
+
+        uint64_t max_len = UINT64_MAX;
+        uint64_t max_tokens = UINT64_MAX; // parentheses included
+        uint32_t max_depth = UINT32_MAX;
+        uint64_t max_steps = UINT64_MAX;
+        const std::atomic<bool> *cancel = nullptr;
+        Clock::time_point deadline = Clock::time_point::max();
+
+        // `CANCELLED` or `TIMED_OUT` at `offset`, `OK` otherwise
+        Error Poll(uint64_t offset) const;
+    };
+
+    inline constexpr uint32_t kBudgetPoll = 1024;
+
+    // Tokens the budgeted chain evaluation accepts whatever the budget: the
+    // chain is built, reduced and freed recursively, one stack frame per
+    // token, and this many stay well within an 8 MiB stack
+    inline constexpr uint64_t kMaxChainTokens = uint64_t(1) << 14;
+
+    // Stand-in for C++23 `std::expected<T, Error>`
+    template <typename T> class Expected {
+      public:
+        Expected(T v) : v_(std::move(v)) {}
+        Expected(Error e) : v_(e) {}
+
+        bool has_value() const { return v_.index() == 0; }
+        explicit operator bool() const { return has_value(); }
+
+        // NOTE: only valid if `has_value()`
+        T &value() { return *std::get_if<0>(&v_); }
+        const T &value() const { return *std::get_if<0>(&v_); }
+        T value_or(T v) const { return has_value() ? value() : v; }
+
+        // NOTE: only valid if `!has_value()`
+        const Error &error() const { return *std::get_if<1>(&v_); }
+
+      private:
+        std::variant<T, Error> v_;
+    };
+
     struct Atom {
         bool sign;
         float value; // IMP: enum class Sign
@@ -56,6 +145,13 @@ namespace expr {
 
     std::vector<char *> split_str(const char *);
 
+    // Non-throwing equivalent of `split_str` + `chrs2atoms` + `atoms2tokens`,
+    // reporting the first error those would throw and the byte offset of
+    // every token. Identifiers bound in `env`, if any, become numbers; the
+    // length, token and depth limits of `budget`, if any, are enforced
+    Error lex(const char *, std::vector<Token> &, std::vector<uint32_t> &,
+              const env::Env *env = nullptr, const Budget *budget = nullptr);
+
     void free_chrs(std::vector<char *> &);
 
     std::vector<Atom> chrs2atoms(const std::vector<char *> &);
@@ -67,7 +163,22 @@ namespace expr {
 
     std::shared_ptr<Chain> reduce(const std::shared_ptr<Chain> &);
 
+    // Same, polling `budget` every `kBudgetPoll` chain nodes counted in
+    // `visited`
+    std::shared_ptr<Chain> reduce(const std::shared_ptr<Chain> &,
+                                  const Budget &budget, uint64_t &visited);
+
     float eval(const std::shared_ptr<Chain> &);
 
     float eval(const char *str);
+
+    // Same, throwing the message of the budget error once a limit is hit.
+    // Every `reduce` applies one operator and counts as a step; `cancel` and
+    // `deadline` are polled every `kBudgetPoll` chain nodes visited, as one
+    // reduction may walk the whole chain
+    float eval(const std::shared_ptr<Chain> &, const Budget &budget);
+
+    // Input over `kMaxChainTokens` tokens fails with `TOO_MANY_TOKENS`,
+    // `prog::try_eval` takes any length
+    float eval(const char *str, const Budget &budget);
 } // namespace expr
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped.hpp"
+#include "prog.hpp"
+
+// Versioned, position-independent binary images of compiled expressions.
+//
+// Layout (all offsets are relative to the start of the file, sections are
+// 8-byte aligned and stored in the byte order of the writer):
+//
+//   Header | Entry[n_expr] | Instr[n_code] | float[n_pool] | char[n_str]
+//
+// The constant pool is shared by all programs and the string table holds the
+// source text of each expression. Loading maps the file read-only and hands
+// out views into it, so nothing is parsed or allocated per expression.
+namespace image {
+
+    inline constexpr char kMagic[4] = {'S', 'C', 'I', 'M'};
+    inline constexpr uint16_t kVersion = 1;
+    // written in native order, reads back as 0x0201 on a foreign host
+    inline constexpr uint16_t kEndian = 0x0102;
+
+    struct Header {
+        char magic[4];
+        uint16_t version;
+        uint16_t endian;
+        uint32_t n_expr;
+        uint32_t n_code;
+        uint32_t n_pool;
+        uint32_t n_str;    // bytes
+        uint64_t checksum; // FNV-1a over everything after the header
+        uint64_t off_expr;
+        uint64_t off_code;
+        uint64_t off_pool;
+        uint64_t off_str;
+    };
+    static_assert(sizeof(Header) == 64);
+
+    struct Entry {
+        uint32_t code;  // index of the first instruction
+        uint32_t size;  // number of instructions
+        uint32_t depth; // max stack depth
+        uint32_t name;  // offset of the source text in the string table
+        uint32_t len;   // length of the source text
+    };
+    static_assert(sizeof(Entry) == 20);
+    static_assert(sizeof(prog::Instr) == 8);
+
+    uint64_t checksum(const void *data, size_t len);
+
+    // Compile each expression and write them into one image
+    void write(const std::string &path, const std::vector<std::string> &srcs);
+
+    // Compile a text file of expressions, one per line; empty lines and lines
+    // starting with '#' are skipped
+    void pack(const std::string &path_in, const std::string &path_out);
+
+    class Image {
+      public:
+        // Map an image and check that every program is well formed (see
+        // `prog::valid`); `verify` also checks the payload checksum, which
+        // touches every page of the file
+        explicit Image(const std::string &path, bool verify = true);
+
+        uint32_t Size() const { return hdr_->n_expr; }
+
+        prog::View Prog(uint32_t i) const;
+
+        std::string_view Source(uint32_t i) const;
+
+        float Eval(uint32_t i) const { return prog::run(Prog(i)); }
+
+      private:
+        mapped::File file_;
+        const Header *hdr_ = nullptr;
+        const Entry *entries_ = nullptr;
+        const prog::Instr *code_ = nullptr;
+        const float *pool_ = nullptr;
+        const char *str_ = nullptr;
+    };
+} // namespace image
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mappings of whole files
+namespace mapped {
+
+    class File {
+      public:
+        File() = default;
+        // Throws `std::runtime_error` if the file cannot be opened or mapped
+        explicit File(const std::string &path);
+        ~File();
+
+        File(const File &) = delete;
+        File &operator=(const File &) = delete;
+        File(File &&) noexcept;
+        File &operator=(File &&) noexcept;
+
+        const char *Data() const { return static_cast<const char *>(base_); }
+        size_t Size() const { return len_; }
+
+      private:
+        void *base_ = nullptr;
+        size_t len_ = 0;
+    };
+} // namespace mapped
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "prog.hpp"
+
+// Memoization of repeated subexpressions across a batch of programs. Each
+// call into libm (`ln`, `^`, `!`, `sin`, ...) is keyed on its operator and
+// the exact bits of its operands, i.e. on the structure of its subtree with
+// every operand already folded into its value, so `ln(4)` or `(3 + 5)!` is
+// computed once per table and looked up wherever it recurs, in any program
+// of the batch.
+// Arithmetic is cheaper than a lookup and always runs
+namespace memo {
+
+    // default number of table slots, 256 KiB
+    inline constexpr size_t kSlots = size_t(1) << 14;
+
+    struct Stats {
+        uint64_t lookups = 0;
+        uint64_t hits = 0;
+        uint64_t inserts = 0;
+        uint64_t evictions = 0; // entries replaced by another key
+
+        double HitRate() const {
+            return lookups == 0 ? 0 : static_cast<double>(hits) / lookups;
+        }
+    };
+
+    // Direct-mapped table of operator values. Memory is fixed at
+    // construction: a new key replaces whatever sits in its slot. Meant to
+    // live for one batch; not thread-safe
+    class Table {
+      public:
+        // `slots` is rounded up to a power of two
+        explicit Table(size_t slots = kSlots);
+
+        // `fn(a, b)` for the operator `op`, from the table if seen before
+        float Apply(uint8_t op, float a, float b);
+
+        // Drop every entry and reset the statistics, for the next batch
+        void Clear();
+
+        size_t Slots() const { return slots_.size(); }
+        const Stats &Usage() const { return stats_; }
+
+      private:
+        struct Slot {
+            uint32_t a; // operand bits
+            uint32_t b;
+            float v;
+            uint8_t op; // IMP: enum class Sign, `Sign::NONE` if empty
+            char padding[3];
+        };
+
+        std::vector<Slot> slots_;
+        Stats stats_;
+    };
+
+    // Same result as `prog::run`, bit for bit
+    float run(const prog::View &v, Table &t);
+
+    // `out` holds one value per view
+    void run_batch(const std::vector<prog::View> &views, float *out,
+                   Table &t);
+} // namespace memo
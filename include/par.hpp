@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "expr.hpp"
+
+namespace pool {
+    class Pool;
+} // namespace pool
+
+// Parallel evaluation of a single huge expression: the string is split at
+// the depth-0 infix operators with the lowest binding power, i.e. the
+// outermost `+ -` or `* /` chain, and the operands between them are lexed
+// and evaluated on a thread pool
+namespace par {
+
+    // inputs shorter than this many bytes are evaluated serially
+    inline constexpr size_t kThreshold = size_t(1) << 18;
+
+    struct Options {
+        size_t threshold = kThreshold;
+        // Sum a `+ -` chain or multiply a `*` chain in parallel chunks
+        // instead of folding the operands left to right. Faster, but rounds
+        // differently from serial evaluation
+        bool reassociate = false;
+        pool::Pool *pool = nullptr; // `pool::shared()` if null
+    };
+
+    // Byte offsets of the operators to split at: every depth-0 infix
+    // operator with the lowest binding power, provided that operator is left
+    // associative and no unary operator binds looser. Empty if there is
+    // nothing to split; the operands themselves are not checked
+    std::vector<uint32_t> split(const char *str);
+
+    // Same results as `prog::try_eval`, bit for bit unless `reassociate`
+    expr::Expected<float> try_eval(const char *str, const Options &opt = {},
+                                   const env::Env *env = nullptr);
+
+    float eval(const char *str, const Options &opt = {});
+} // namespace par
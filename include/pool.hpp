@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads for data-parallel loops
+namespace pool {
+
+    class Pool {
+      public:
+        // 0 means one worker per hardware thread
+        explicit Pool(unsigned n = 0);
+        ~Pool();
+
+        Pool(const Pool &) = delete;
+        Pool &operator=(const Pool &) = delete;
+
+        // number of threads taking part in `For`, including the caller
+        unsigned Size() const {
+            return static_cast<unsigned>(workers_.size()) + 1;
+        }
+
+        // Call `fn(begin, end)` on chunks of at most `grain` indices covering
+        // [0, n) and block until all of them are done. The calling thread
+        // takes chunks too. Loops from different threads run one at a time;
+        // `fn` must not throw nor call `For` on the same pool
+        void For(size_t n, size_t grain,
+                 const std::function<void(size_t, size_t)> &fn);
+
+      private:
+        void Work();
+        void Drain();
+
+        std::vector<std::thread> workers_;
+        std::mutex mtx_;      // guards the job fields below
+        std::mutex mtx_for_;  // serializes `For`
+        std::condition_variable cv_job_;
+        std::condition_variable cv_done_;
+        uint64_t gen_ = 0;    // bumped for every job
+        bool stop_ = false;
+        unsigned n_busy_ = 0; // workers still inside the current job
+
+        const std::function<void(size_t, size_t)> *fn_ = nullptr;
+        size_t n_ = 0;
+        size_t grain_ = 1;
+        std::atomic<size_t> next_{0};
+    };
+
+    // Process-wide pool sized to the hardware
+    Pool &shared();
+} // namespace pool
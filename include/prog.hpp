@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "expr.hpp"
+#include "vmath.hpp"
+
+// Compiled expressions: flat postfix (RPN) programs evaluated by a stack
+// machine, with no Chain nodes and no recursion
+namespace prog {
+
+    struct Instr {
+        uint8_t op; // IMP: enum class Sign, `Sign::NONE` pushes a constant
+        char padding[3];
+        uint32_t arg; // constant pool index (push only)
+    };
+
+    // Non-owning view of a program, e.g. into a mapped image
+    struct View {
+        const Instr *code;
+        uint32_t size;
+        const float *pool;
+        uint32_t depth; // max stack depth
+    };
+
+    struct Program {
+        std::vector<Instr> code;
+        std::vector<float> pool;
+        uint32_t depth = 0;
+
+        View view() const {
+            return {code.data(), static_cast<uint32_t>(code.size()),
+                    pool.data(), depth};
+        }
+    };
+
+    // Check the token sequence against the grammar accepted by
+    // `expr::tokens2chain`, returning the first error it would throw. Offsets
+    // are those from `expr::lex`, if any
+    expr::Error verify(const std::vector<expr::Token> &,
+                       const std::vector<uint32_t> *offsets = nullptr);
+
+    // Throwing version of `verify`
+    void check(const std::vector<expr::Token> &);
+
+    Program compile(const std::vector<expr::Token> &);
+
+    // Identifiers bound in `env`, if any, are compiled in as constants
+    Program compile(const char *str, const env::Env *env = nullptr);
+
+    // Non-throwing API: nothing on these paths throws, malformed input is
+    // reported as an `expr::Error`, and so is input over `budget`, if any.
+    // Every operator applied by `try_eval` counts as a step
+    expr::Expected<Program> try_compile(const char *str,
+                                        const env::Env *env = nullptr,
+                                        const expr::Budget *budget = nullptr);
+
+    // Same, from the tokens and offsets of `expr::lex`. Every number token
+    // takes the next constant of the pool, in order
+    expr::Expected<Program>
+    try_compile(const std::vector<expr::Token> &tokens,
+                const std::vector<uint32_t> &offsets);
+
+    expr::Expected<float> try_eval(const char *str,
+                                   const env::Env *env = nullptr,
+                                   const expr::Budget *budget = nullptr);
+
+    // Check a program from outside the compiler, e.g. a mapped image, by
+    // simulating its stack: every operator is known, every push reads one
+    // of the `n_pool` constants, no operator underflows, one value is left
+    // and the height peaks at exactly `v.depth`
+    bool valid(const View &v, uint32_t n_pool);
+
+    // `stack` must hold at least `v.depth` floats
+    float run(const View &v, float *stack);
+
+    float run(const View &v);
+
+    float eval(const char *str);
+
+    // Evaluate many programs at once, level by level: every instruction is
+    // placed at its height in the expression tree and all instructions of
+    // one level and one operator run as a single array kernel. `out` holds
+    // one value per view. With `Accuracy::EXACT` the results are
+    // bit-identical to `run`
+    void run_batch(const std::vector<View> &views, float *out,
+                   vmath::Accuracy acc);
+
+    // Same, with the per-thread accuracy from `vmath::get_accuracy`
+    void run_batch(const std::vector<View> &views, float *out);
+} // namespace prog
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "env.hpp"
+#include "exact.hpp"
+#include "expr.hpp"
+
+// Statements over an environment, one per line: `name = expr` binds the value
+// of `expr`, anything else is evaluated as an expression. Blank lines and
+// lines starting with `#` do nothing. A bound name is substituted by its
+// value when later lines are lexed, so it is never parsed or evaluated again
+namespace script {
+
+    enum class Kind : uint8_t {
+        NONE = 0, // blank line or comment
+        EXPR,
+        ASSIGN,
+    };
+
+    struct Stmt {
+        Kind kind = Kind::NONE;
+        std::string_view name; // assigned name, points into the line
+        float value = 0;
+    };
+
+    // Run one statement; error offsets are relative to `line`
+    expr::Expected<Stmt> exec(const std::string &line, env::Env &env);
+
+    struct ExactStmt {
+        Kind kind = Kind::NONE;
+        std::string_view name;
+        exact::Value value;
+    };
+
+    // Same over exact bindings, evaluated by `exact::try_eval` if `exact`
+    // and in float otherwise
+    expr::Expected<ExactStmt> exec(const std::string &line, exact::Env &env,
+                                   bool exact);
+
+    // Run every line, writing the value of each expression to `out`. Throws
+    // `std::runtime_error` naming the line of the first error
+    void run(std::istream &in, env::Env &env, std::ostream &out);
+
+    void run(const std::string &path, env::Env &env, std::ostream &out);
+} // namespace script
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "expr.hpp"
+
+// Evaluation service over POSIX shared memory. A client and a server map the
+// same region, which holds two lock-free single-producer / single-consumer
+// rings: expressions one way, values or errors the other. While both sides
+// poll, a round trip makes no system call; a side finding its ring empty
+// or full either keeps polling or sleeps on a futex until the other wakes it
+namespace shm {
+
+    // default ring capacity, in messages
+    inline constexpr uint32_t kSlots = 1024;
+    // longest expression, in bytes
+    inline constexpr size_t kMaxText = 115;
+
+    enum class Wait : uint8_t {
+        SPIN = 0, // poll, yielding the CPU between rounds
+        FUTEX,    // poll briefly, then sleep until woken (Linux only, SPIN
+                  // elsewhere)
+    };
+
+    struct Request {
+        uint64_t tag; // echoed in the response
+        uint32_t len;
+        char text[kMaxText + 1];
+    };
+
+    struct Response {
+        uint64_t tag;
+        float value;
+        uint32_t offset; // of the error, if any
+        expr::Errc code; // `Errc::OK` on success
+        char padding[7];
+    };
+
+    class Channel {
+      public:
+        // Create the region `name`, e.g. `/scicalc`, replacing a stale one
+        // left by a crashed server. The creator unlinks it when destroyed
+        static Channel Create(const std::string &name,
+                              uint32_t slots = kSlots);
+
+        // Attach to the region of a running server
+        static Channel Open(const std::string &name);
+
+        Channel(Channel &&o) noexcept;
+        ~Channel();
+
+        Channel(const Channel &) = delete;
+        Channel &operator=(const Channel &) = delete;
+        Channel &operator=(Channel &&) = delete;
+
+        uint32_t Slots() const;
+
+        // Client side. Responses come back in request order. Keep at most
+        // `Slots()` requests in flight: the server blocks on a full response
+        // ring until the client reads it
+        //
+        // false if the request ring is full; throws if `expr` is longer
+        // than `kMaxText`
+        bool TrySend(uint64_t tag, std::string_view expr);
+        void Send(uint64_t tag, std::string_view expr, Wait w);
+        bool TryRecv(Response &r);
+        void Recv(Response &r, Wait w);
+        // no more requests, `Serve` returns once the rest are answered
+        void Close();
+
+        // Server side: evaluate the requests in place, in order, until the
+        // client closes the channel. Returns the number of requests served
+        uint64_t Serve(Wait w, const env::Env *env = nullptr);
+
+      private:
+        struct Region;
+
+        Channel(std::string name, bool owner, void *base, size_t len);
+
+        std::string name_;
+        bool owner_;
+        void *base_;
+        size_t len_;
+        Region *hdr_;
+        Request *req_;
+        Response *resp_;
+    };
+} // namespace shm
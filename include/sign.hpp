@@ -0,0 +1,308 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+// Sign tables shared by the Pratt parser (expr) and the compiled program
+// backends (prog, image)
+namespace expr {
+
+    inline constexpr float kFNan = std::numeric_limits<float>::quiet_NaN();
+    inline constexpr float kFDummy = 0.0f;
+
+    // binding power delta for parenthesis
+    inline constexpr int8_t kBpDelta = 10;
+
+    // start of helpers
+    inline constexpr uint8_t kMinSignHelper = 1;
+    // start of constants
+    inline constexpr uint8_t kMinSignConst = 21;
+    // start of operators (unary / binary associative)
+    inline constexpr uint8_t kMinSignOp = 101;
+    inline constexpr uint8_t kOpSize = 17;
+
+    // Both operatoers (left, right and infix) and helpers (parentheses)
+    // used by `Atom.value`
+    //
+    // NOTE:
+    // - when adding new operators, make sure to update
+    //   - `kOpSize`
+    //   - `kMapOp2Fn`
+    //   - `kMapOp2Bp`
+    //   - `kIdents` if named
+    // - adding constants: update `kMapConst2Real` and `kIdents`
+    enum class Sign : uint8_t {
+        NONE = 0,
+        // helpers
+        PAL = kMinSignHelper, // (
+        PAR,                  // )
+        CMA,                  // , between the arguments of a call
+        // constants
+        PI = kMinSignConst, // pi
+        E,                  // e
+        // operators, size = kOpSize
+        FCT = kMinSignOp, // factorial (left associative)
+        LOG,              // log (right associative)
+        ADD,              // +
+        SUB,              // -
+        MUL,              // *
+        DIV,              // /
+        EXP,              // ^
+        UAD,              // unary add (right associative)
+        USB,              // unary sub (right associative)
+        SIN,              // sin (right associative)
+        COS,              // cos
+        TAN,              // tan
+        SQT,              // sqrt
+        EXF,              // exp, e^x
+        ABS,              // abs
+        MIN,              // min(a, b), the `,` of the call is infix
+        MAX,              // max(a, b)
+    };
+
+    enum class SignType : uint8_t {
+        NONE = 0,
+        CON = 1, // constant
+        OPL = 2, // left associative unary operator e.g. !
+        OPR = 3, // right associative unary operator e.g. ln
+        OPI = 4, // infix operator
+    };
+
+    // map constant signs
+    inline constexpr std::array<float, 2> kMapConst2Real{
+        3.14159265358979323846f, // PI (kMinSignConst)
+        2.71828182845904523536f, // E
+    };
+
+    // map Operator to function
+    inline const std::array<float (*)(const float, const float), kOpSize>
+        kMapOp2Fn{
+            // factorial (kMinSignOp)
+            [](float a, float) { return std::tgamma(a + 1); },
+            // log, exclude 0 and negative values
+            [](float a, float) { return (a > 0) ? std::log(a) : kFNan; },
+            [](float a, float b) { return a + b; },
+            [](float a, float b) { return a - b; }, // SUB
+            [](float a, float b) { return a * b; }, // MUL
+            [](float a, float b) { return a / b; }, // DIV
+            [](float a, float b) { return std::pow(a, b); }, // EXP
+            [](float a, float) { return a; },                // UAD
+            [](float a, float) { return -a; },               // USB
+            [](float a, float) { return std::sin(a); },      // SIN
+            [](float a, float) { return std::cos(a); },      // COS
+            [](float a, float) { return std::tan(a); },      // TAN
+            [](float a, float) { return std::sqrt(a); },     // SQT
+            [](float a, float) { return std::exp(a); },      // EXF
+            [](float a, float) { return std::fabs(a); },     // ABS
+            // min and max, NaN if either is
+            [](float a, float b) { return (a < b || a != a) ? a : b; },
+            [](float a, float b) { return (a > b || a != a) ? a : b; },
+        };
+
+    inline constexpr std::array<std::pair<uint8_t, uint8_t>, kOpSize>
+        kMapOp2Bp{
+            std::make_pair(6, 0), // factorial (kMinSignOp)
+            std::make_pair(0, 5), // log
+            std::make_pair(1, 1), // +
+            std::make_pair(1, 1), // -
+            std::make_pair(2, 2), // *
+            std::make_pair(2, 2), // /
+            std::make_pair(4, 3), // left-skewed
+            std::make_pair(0, 1), // unary add
+            std::make_pair(0, 1), // unary sub
+            std::make_pair(0, 5), // sin, as log
+            std::make_pair(0, 5), // cos
+            std::make_pair(0, 5), // tan
+            std::make_pair(0, 5), // sqrt
+            std::make_pair(0, 5), // exp
+            std::make_pair(0, 5), // abs
+            // min and max: the `,` of a call binds as an operator one level
+            // of parentheses out, looser than anything between them
+            std::make_pair(kBpDelta, kBpDelta),
+            std::make_pair(kBpDelta, kBpDelta),
+        };
+
+    // Binding power for operators
+    inline std::pair<uint8_t, uint8_t> get_bp(uint8_t op) {
+        try {
+            return kMapOp2Bp.at(op - kMinSignOp);
+        } catch (const std::out_of_range &) {
+            throw std::runtime_error("Unknown operator");
+        }
+    }
+
+    inline constexpr SignType sign2optype(const uint8_t op) {
+        if (op >= kMinSignOp) {
+            auto [bpl, bpr] = get_bp(op);
+
+            if (bpl == 0 && bpr == 0)
+                return SignType::NONE;
+            if (bpl == 0)
+                return SignType::OPR;
+            if (bpr == 0)
+                return SignType::OPL;
+            return SignType::OPI;
+        }
+
+        if (op >= kMinSignConst)
+            return SignType::CON;
+        return SignType::NONE;
+    }
+
+    // Calls whose arguments are separated by `,`, e.g. `min(a, b)`
+    inline constexpr bool is_call(const uint8_t sign) {
+        return sign == static_cast<uint8_t>(Sign::MIN) ||
+               sign == static_cast<uint8_t>(Sign::MAX);
+    }
+
+    struct Ident {
+        std::string_view name;
+        Sign sign;
+    };
+
+    // Named functions and constants
+    inline constexpr Ident kIdents[] = {
+        {"ln", Sign::LOG},   {"pi", Sign::PI},   {"e", Sign::E},
+        {"sin", Sign::SIN},  {"cos", Sign::COS}, {"tan", Sign::TAN},
+        {"sqrt", Sign::SQT}, {"exp", Sign::EXF}, {"abs", Sign::ABS},
+        {"min", Sign::MIN},  {"max", Sign::MAX},
+    };
+
+    inline constexpr unsigned kIdentBits = 6;
+    inline constexpr size_t kIdentSlots = size_t(1) << kIdentBits;
+
+    // Slot of an identifier: its first and last characters and its length,
+    // multiplied by `seed`
+    inline constexpr size_t ident_hash(const std::string_view s,
+                                       const uint32_t seed) {
+        const uint32_t k = uint32_t(static_cast<uint8_t>(s.front())) << 16 |
+                           uint32_t(static_cast<uint8_t>(s.back())) << 8 |
+                           static_cast<uint8_t>(s.size());
+        return (k * seed) >> (32 - kIdentBits);
+    }
+
+    // First odd multiplier from the golden ratio under which no two names
+    // of `kIdents` share a slot, i.e. a perfect hash
+    inline constexpr uint32_t kIdentSeed = [] {
+        for (uint32_t seed = 0x9e3779b1; seed != 0x9e3779b1 + (1u << 20);
+             seed += 2) {
+            std::array<bool, kIdentSlots> used{};
+            bool ok = true;
+            for (const auto &id : kIdents) {
+                const size_t h = ident_hash(id.name, seed);
+                ok = ok && !used[h];
+                used[h] = true;
+            }
+            if (ok)
+                return seed;
+        }
+        return 0u;
+    }();
+    // two names with the same first and last characters and length would
+    // need more of their characters hashed
+    static_assert(kIdentSeed != 0, "no perfect hash of `kIdents`");
+
+    // map slot to index in `kIdents` + 1, 0 if empty
+    inline constexpr std::array<uint8_t, kIdentSlots> kMapSlot2Ident = [] {
+        std::array<uint8_t, kIdentSlots> t{};
+        for (size_t i = 0; i < std::size(kIdents); ++i)
+            t[ident_hash(kIdents[i].name, kIdentSeed)] =
+                static_cast<uint8_t>(i + 1);
+        return t;
+    }();
+
+    // Sign of an identifier, 0 if unknown. Identifiers match exactly, with
+    // one table lookup and one comparison
+    inline constexpr uint8_t ident2sign(const char *str, const size_t len) {
+        if (len == 0)
+            return static_cast<uint8_t>(Sign::NONE);
+        const std::string_view s(str, len);
+        const uint8_t i = kMapSlot2Ident[ident_hash(s, kIdentSeed)];
+        if (i == 0 || kIdents[i - 1].name != s)
+            return static_cast<uint8_t>(Sign::NONE);
+        return static_cast<uint8_t>(kIdents[i - 1].sign);
+    }
+
+    // map character to sign of a single-character symbol, 0 if none
+    inline constexpr std::array<uint8_t, 256> kMapChr2Sign = [] {
+        std::array<uint8_t, 256> t{};
+        t['!'] = static_cast<uint8_t>(Sign::FCT);
+        t['+'] = static_cast<uint8_t>(Sign::ADD);
+        t['-'] = static_cast<uint8_t>(Sign::SUB);
+        t['*'] = static_cast<uint8_t>(Sign::MUL);
+        t['/'] = static_cast<uint8_t>(Sign::DIV);
+        t['^'] = static_cast<uint8_t>(Sign::EXP);
+        t['('] = static_cast<uint8_t>(Sign::PAL);
+        t[')'] = static_cast<uint8_t>(Sign::PAR);
+        t[','] = static_cast<uint8_t>(Sign::CMA);
+        return t;
+    }();
+
+    // Sign of a single-character symbol, 0 if unknown
+    inline constexpr uint8_t chr2sign(const char c) {
+        return kMapChr2Sign[static_cast<uint8_t>(c)];
+    }
+
+    // `(` / `)` / `,` of the calls met while lexing: which call, if any,
+    // each level of parentheses belongs to, and whether it has a `,` yet.
+    // Fixed size, as `lpar` is 8-bit
+    class Calls {
+      public:
+        // A call's identifier, which must be followed by `(`
+        void Open(uint8_t sign) { pending_ = sign; }
+        // Whether a call's identifier waits for its `(`
+        bool Pending() const { return pending_ != 0; }
+        // `(` entering level `lpar`
+        void Enter(uint8_t lpar) {
+            ops_[lpar] = pending_;
+            split_[lpar] = false;
+            pending_ = 0;
+        }
+        // Operator of a `,` at level `lpar`, 0 if not directly in a call
+        uint8_t Comma(uint8_t lpar) {
+            split_[lpar] = true;
+            return ops_[lpar];
+        }
+        // `)` leaving level `lpar`, false if it closes a call without a `,`
+        bool Leave(uint8_t lpar) const {
+            return ops_[lpar] == 0 || split_[lpar];
+        }
+
+      private:
+        std::array<uint8_t, 256> ops_{};
+        std::array<bool, 256> split_{};
+        uint8_t pending_ = 0;
+    };
+
+    // Value of a run of digits and dots, e.g. `12.5`. The fraction is kept
+    // here but truncated by the callers
+    inline float digits2num(const char *str, const size_t len) {
+        float value = 0;
+        float decimal = 0.1f;
+        bool is_decimal = false;
+
+        for (size_t i = 0; i < len; ++i) {
+            if (str[i] == '.') {
+                is_decimal = true;
+                if (++i == len)
+                    break;
+            }
+
+            if (is_decimal) {
+                value += (str[i] - '0') * decimal;
+                decimal *= 0.1f;
+            } else {
+                value = value * 10 + (str[i] - '0');
+            }
+        }
+        return value;
+    }
+
+} // namespace expr
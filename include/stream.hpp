@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "expr.hpp"
+#include "sign.hpp"
+
+// Streaming evaluation of a single expression too large to keep in memory:
+// the input is fed in chunks of any size, lexed on the fly and reduced by an
+// incremental shunting-yard. Only the pending operators and operands are
+// kept, so memory grows with the nesting depth, not with the input length
+namespace stream {
+
+    // bytes read at a time from a stream or a file descriptor
+    inline constexpr size_t kChunk = size_t(1) << 16;
+
+    class Evaluator {
+      public:
+        // Identifiers bound in `env`, if any, become numbers; `env` must
+        // outlive the evaluator
+        explicit Evaluator(const env::Env *env = nullptr) : env_(env) {}
+
+        // Lex and reduce the next `len` bytes of the input. A token may
+        // span several calls. False once an error was found, which is then
+        // reported by `Finish`; later input is ignored
+        bool Feed(const char *data, size_t len);
+
+        // End of input. Valid input gives the value of `prog::try_eval`,
+        // bit for bit. Errors are checked in reading order, so for invalid
+        // input this is the first error from the left, while the serial path
+        // reports unknown symbols first and grammar errors from the right
+        expr::Expected<float> Finish();
+
+        // start over, keeping the buffers
+        void Reset();
+
+        uint64_t Size() const { return pos_; } // bytes fed so far
+
+        // largest number of operands and operators held at once
+        size_t Peak() const { return peak_; }
+
+      private:
+        enum class Lexeme : uint8_t {
+            NONE = 0,
+            NUM,   // digits and dots
+            IDENT, // letters
+        };
+
+        // the token ending at the current position
+        void EndLexeme();
+        void Push(uint8_t sign, float num, uint64_t off);
+        void Flush(uint8_t lbp);
+        void Fail(expr::Errc code, uint64_t off, const char *msg);
+
+        const env::Env *env_;
+        expr::Error err_;
+        uint64_t pos_ = 0;
+        std::string lexeme_; // token split across `Feed` calls
+        Lexeme kind_ = Lexeme::NONE;
+        uint64_t lexeme_off_ = 0;
+        uint64_t last_ = 0; // offset of the last token
+        bool first_ = true;    // no lexeme seen yet
+        bool operand_ = false; // an operand is complete, expect an operator
+        bool empty_ = true;    // no operand nor operator seen yet
+        uint8_t lpar_ = 0;     // left parenthesis count
+        expr::Calls calls_;
+        std::vector<expr::Token::Op> ops_;
+        std::vector<float> stack_;
+        size_t peak_ = 0;
+    };
+
+    // Read `in` to its end, `chunk` bytes at a time
+    expr::Expected<float> try_eval(std::istream &in,
+                                   const env::Env *env = nullptr,
+                                   size_t chunk = kChunk);
+
+    // Same from a file descriptor, which is read but not closed
+    expr::Expected<float> try_eval(int fd, const env::Env *env = nullptr,
+                                   size_t chunk = kChunk);
+
+    // Throwing version over a file, `-` for standard input
+    float eval(const std::string &path);
+} // namespace stream
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Array kernels for the expensive operators (log, pow, tgamma) with
+// selectable accuracy. Main loops are branch-free so the compiler can
+// vectorize them; special inputs (zero, negative, inf, NaN, subnormal, the
+// reflection range of tgamma) are patched up afterwards with double precision
+// libm.
+namespace vmath {
+
+    enum class Accuracy : uint8_t {
+        EXACT = 0, // libm, bit-identical to scalar evaluation
+        ULP1,      // within 1 ULP of the correctly rounded result
+        ULP4,      // within 4 ULP, fewer polynomial terms
+    };
+
+    // Accuracy used by callers that do not pass one, per thread
+    Accuracy get_accuracy();
+    void set_accuracy(Accuracy);
+
+    // Set the per-thread accuracy for the lifetime of the guard
+    class ScopedAccuracy {
+      public:
+        explicit ScopedAccuracy(Accuracy acc) : prev_(get_accuracy()) {
+            set_accuracy(acc);
+        }
+        ~ScopedAccuracy() { set_accuracy(prev_); }
+
+        ScopedAccuracy(const ScopedAccuracy &) = delete;
+        ScopedAccuracy &operator=(const ScopedAccuracy &) = delete;
+
+      private:
+        Accuracy prev_;
+    };
+
+    // out[i] = log(x[i])
+    void log(const float *x, float *out, size_t n, Accuracy acc);
+
+    // out[i] = pow(x[i], y[i])
+    void pow(const float *x, const float *y, float *out, size_t n,
+             Accuracy acc);
+
+    // out[i] = tgamma(x[i])
+    void tgamma(const float *x, float *out, size_t n, Accuracy acc);
+
+    // Distance in units in the last place; 0 if both are NaN or equal
+    uint32_t ulp_diff(float a, float b);
+} // namespace vmath
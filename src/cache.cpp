@@ -0,0 +1,402 @@
+// Persistent cache of batch results in an append-only mapped file
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.hpp"
+#include "prog.hpp"
+
+namespace {
+
+    static constexpr uint64_t kSeedLo = 0x9e3779b97f4a7c15ULL;
+    static constexpr uint64_t kSeedHi = 0xc2b2ae3d27d4eb4fULL;
+    static constexpr size_t kMinIndex = 16;
+    // record numbers + 1 must fit the index
+    static constexpr size_t kMaxRecords = UINT32_MAX - 1;
+    // bytes of output buffered by `run` between writes
+    static constexpr size_t kOutChunk = size_t(1) << 16;
+    // lines looked up together by `run`
+    static constexpr size_t kBlock = 32;
+    // compaction keeps 1/kCompactDiv of the records the size limit allows,
+    // so that the flushes after it append rather than compact again
+    static constexpr size_t kCompactDiv = 2;
+
+    // MurmurHash3 finalizer, a bijection
+    uint64_t fmix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    uint32_t check(const cache::Record &r) {
+        uint64_t w[3];
+        uint32_t t;
+        std::memcpy(w, &r, sizeof(w));
+        std::memcpy(&t, reinterpret_cast<const char *>(&r) + sizeof(w),
+                    sizeof(t));
+        return static_cast<uint32_t>(fmix(w[0] ^ fmix(w[1] ^ fmix(w[2] ^ t))));
+    }
+
+    // `isspace` in the C locale, as the lexers skip
+    bool is_blank(const char c) {
+        return (c == ' ') |
+               (static_cast<unsigned char>(c - '\t') <= '\r' - '\t');
+    }
+
+    bool write_all(const int fd, const void *data, size_t len) {
+        const char *p = static_cast<const char *>(data);
+        while (len > 0) {
+            const ssize_t n = write(fd, p, len);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            p += n;
+            len -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    cache::Header make_header() {
+        cache::Header hdr{};
+        std::memcpy(hdr.magic, cache::kMagic, sizeof(cache::kMagic));
+        hdr.version = cache::kVersion;
+        hdr.endian = cache::kEndian;
+        return hdr;
+    }
+
+} // namespace
+
+void cache::normalize(const std::string_view line, std::string &out) {
+    const size_t n = line.size();
+    // most lines are normal already; branch free, as blanks are frequent
+    bool abnormal = n > 0 && (is_blank(line[0]) || is_blank(line[n - 1]));
+    for (size_t i = 1; i < n; ++i)
+        abnormal |=
+            is_blank(line[i]) & ((line[i] != ' ') | (line[i - 1] == ' '));
+    if (!abnormal) {
+        out.assign(line);
+        return;
+    }
+
+    out.clear();
+    size_t i = 0;
+    while (i < n) {
+        while (i < n && is_blank(line[i]))
+            ++i;
+        size_t j = i;
+        while (j < n && !is_blank(line[j]))
+            ++j;
+        if (j > i) {
+            if (!out.empty())
+                out += ' ';
+            out.append(line.data() + i, j - i);
+        }
+        i = j;
+    }
+}
+
+std::string cache::normalize(const std::string_view line) {
+    std::string s;
+    normalize(line, s);
+    return s;
+}
+
+// Two lanes over 8-byte words, each word mixed in with a bijection
+cache::Key cache::key(const std::string_view text) {
+    uint64_t lo = kSeedLo;
+    uint64_t hi = kSeedHi;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= text.size(); i += sizeof(uint64_t)) {
+        uint64_t w;
+        std::memcpy(&w, text.data() + i, sizeof(w));
+        lo = fmix(lo ^ w);
+        hi = fmix(hi ^ std::rotl(w, 32));
+    }
+    if (i < text.size()) {
+        uint64_t w = 0;
+        std::memcpy(&w, text.data() + i, text.size() - i);
+        lo = fmix(lo ^ w);
+        hi = fmix(hi ^ std::rotl(w, 32));
+    }
+    return {fmix(lo ^ text.size()), fmix(hi + text.size())};
+}
+
+cache::Store::Store(const std::string &path, const size_t max_bytes)
+    : path_(path), max_bytes_(max_bytes) {
+    Open();
+}
+
+cache::Store::~Store() {
+    try {
+        Flush();
+    } catch (const std::exception &) {
+        // a cache that cannot be written only costs the next run time
+    }
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void cache::Store::Open() {
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+        throw std::runtime_error("Cannot open cache: " + path_);
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+        throw std::runtime_error("Cannot stat cache: " + path_);
+
+    size_t len = static_cast<size_t>(st.st_size);
+    const Header want = make_header();
+    Header hdr;
+    if (len < sizeof(Header) ||
+        pread(fd_, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        std::memcmp(hdr.magic, want.magic, sizeof(kMagic)) != 0 ||
+        hdr.endian != want.endian || hdr.version != want.version) {
+        // new, foreign or from another version: start over
+        if (ftruncate(fd_, 0) != 0 || !write_all(fd_, &want, sizeof(want)))
+            throw std::runtime_error("Cannot write cache: " + path_);
+        len = sizeof(Header);
+    }
+
+    file_ = mapped::File(path_);
+    len = std::min(len, file_.Size());
+    mapped_ = reinterpret_cast<const Record *>(file_.Data() + sizeof(Header));
+    const size_t n =
+        std::min((len - sizeof(Header)) / sizeof(Record), kMaxRecords);
+    size_t good = 0;
+    while (good < n && check(mapped_[good]) == mapped_[good].check)
+        ++good;
+    const size_t end = sizeof(Header) + good * sizeof(Record);
+    if (end != len && ftruncate(fd_, static_cast<off_t>(end)) != 0)
+        throw std::runtime_error("Cannot write cache: " + path_);
+
+    n_mapped_ = static_cast<uint32_t>(good);
+    added_.clear();
+    n_flushed_ = 0;
+    used_.assign(good, 0);
+    Reindex();
+}
+
+const cache::Record &cache::Store::At(const uint32_t i) const {
+    return i < n_mapped_ ? mapped_[i] : added_[i - n_mapped_];
+}
+
+uint32_t *cache::Store::Slot(const Key &k) {
+    const size_t mask = index_.size() - 1;
+    size_t i = k.lo & mask;
+    while (index_[i] != 0 && At(index_[i] - 1).key != k)
+        i = (i + 1) & mask;
+    return &index_[i];
+}
+
+// the newest record of a key shadows the older ones
+void cache::Store::Index(const uint32_t i) {
+    uint32_t *s = Slot(At(i).key);
+    if (*s == 0)
+        ++n_keys_;
+    *s = i + 1;
+}
+
+void cache::Store::Reindex() {
+    const size_t n = n_mapped_ + added_.size();
+    // at most a quarter full, so that a run adding a few percent of new
+    // keys never rebuilds it; rebuilt when half full
+    size_t cap = kMinIndex;
+    while (cap < 4 * (n + 1))
+        cap <<= 1;
+    index_.assign(cap, 0);
+    n_keys_ = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        Index(i);
+}
+
+std::optional<expr::Expected<float>> cache::Store::Find(const Key &k) {
+    ++stats_.lookups;
+    const uint32_t s = *Slot(k);
+    if (s == 0)
+        return std::nullopt;
+    ++stats_.hits;
+    used_[s - 1] = 1;
+    const Record &r = At(s - 1);
+    if (r.code == expr::Errc::OK)
+        return expr::Expected<float>(r.value);
+    return expr::Expected<float>(
+        expr::Error{r.code, r.offset, expr::message(r.code)});
+}
+
+void cache::Store::Prefetch(const Key *keys, const size_t n) const {
+    const size_t mask = index_.size() - 1;
+    for (size_t i = 0; i < n; ++i)
+        __builtin_prefetch(&index_[keys[i].lo & mask]);
+    // the home slot usually holds the key, if present
+    for (size_t i = 0; i < n; ++i)
+        if (const uint32_t s = index_[keys[i].lo & mask]; s != 0)
+            __builtin_prefetch(&At(s - 1));
+}
+
+void cache::Store::Insert(const Key &k, const expr::Expected<float> &r) {
+    if (n_mapped_ + added_.size() >= kMaxRecords)
+        return;
+    Record rec{};
+    rec.key = k;
+    if (r) {
+        rec.value = r.value();
+    } else {
+        rec.code = r.error().code;
+        rec.offset = static_cast<uint32_t>(r.error().offset);
+    }
+    rec.check = check(rec);
+    added_.push_back(rec);
+    used_.push_back(1);
+    ++stats_.inserts;
+    if (2 * (n_keys_ + 1) > index_.size())
+        Reindex();
+    else
+        Index(static_cast<uint32_t>(n_mapped_ + added_.size() - 1));
+}
+
+void cache::Store::Flush() {
+    if (n_flushed_ < added_.size()) {
+        if (!write_all(fd_, added_.data() + n_flushed_,
+                       (added_.size() - n_flushed_) * sizeof(Record)))
+            throw std::runtime_error("Cannot write cache: " + path_);
+        n_flushed_ = added_.size();
+    }
+    if (Bytes() > max_bytes_)
+        Compact();
+}
+
+void cache::Store::Compact() {
+    // the newest record of every key, used ones first, each in file order
+    std::vector<uint32_t> keep;
+    keep.reserve(n_keys_);
+    for (const uint32_t s : index_)
+        if (s != 0)
+            keep.push_back(s - 1);
+    std::sort(keep.begin(), keep.end());
+    std::stable_partition(keep.begin(), keep.end(),
+                          [&](const uint32_t i) { return used_[i] != 0; });
+    const size_t cap =
+        max_bytes_ > sizeof(Header)
+            ? (max_bytes_ - sizeof(Header)) / sizeof(Record) / kCompactDiv
+            : 0;
+    if (keep.size() > cap)
+        keep.resize(cap);
+
+    std::vector<Record> recs;
+    std::vector<uint8_t> used;
+    recs.reserve(keep.size());
+    used.reserve(keep.size());
+    for (const uint32_t i : keep) {
+        recs.push_back(At(i));
+        used.push_back(used_[i]);
+    }
+
+    // written aside and renamed over, so that the file is never partial
+    const std::string tmp = path_ + ".tmp" + std::to_string(getpid());
+    const Header hdr = make_header();
+    const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0644);
+    bool ok = fd >= 0 && write_all(fd, &hdr, sizeof(hdr)) &&
+              write_all(fd, recs.data(), recs.size() * sizeof(Record));
+    if (fd >= 0)
+        ok = close(fd) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), path_.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw std::runtime_error("Cannot compact cache: " + path_);
+    }
+
+    close(fd_);
+    fd_ = -1;
+    Open();
+    used.resize(used_.size(), 0);
+    used_ = std::move(used);
+    ++stats_.compactions;
+}
+
+size_t cache::Store::Bytes() const {
+    return sizeof(Header) + (n_mapped_ + added_.size()) * sizeof(Record);
+}
+
+expr::Expected<float> cache::eval(Store &store, const std::string &text) {
+    return eval(store, text, key(text));
+}
+
+expr::Expected<float> cache::eval(Store &store, const std::string &text,
+                                  const Key &k) {
+    if (auto r = store.Find(k))
+        return *r;
+    // without a budget, errors depend on the text alone
+    auto r = prog::try_eval(text.c_str());
+    store.Insert(k, r);
+    return r;
+}
+
+void cache::run(const std::string &path, Store *store, std::ostream &out) {
+    const mapped::File file(path);
+    const char *p = file.Data();
+    const char *const end = p + file.Size();
+    std::string buf;
+    char num[32];
+    // lines are read in blocks so that their lookups are prefetched together
+    std::string texts[kBlock];
+    Key keys[kBlock];
+    while (p < end) {
+        size_t n = 0;
+        for (; n < kBlock && p < end;) {
+            const auto *nl =
+                static_cast<const char *>(std::memchr(p, '\n', end - p));
+            const char *eol = nl != nullptr ? nl : end;
+            const std::string_view line(p, eol - p);
+            p = nl != nullptr ? nl + 1 : end;
+            if (line.empty() || line[0] == '#')
+                continue;
+            normalize(line, texts[n]);
+            if (store != nullptr)
+                keys[n] = key(texts[n]);
+            ++n;
+        }
+        if (store != nullptr)
+            store->Prefetch(keys, n);
+
+        for (size_t i = 0; i < n; ++i) {
+            const std::string &text = texts[i];
+            const auto r = store != nullptr ? eval(*store, text, keys[i])
+                                            : prog::try_eval(text.c_str());
+            buf += text;
+            if (r) {
+                // `%g`, as `std::ostream` prints floats
+                const auto res =
+                    std::to_chars(num, num + sizeof(num), r.value(),
+                                  std::chars_format::general, 6);
+                buf += " = ";
+                buf.append(num, res.ptr);
+            } else {
+                buf += " : ";
+                buf += r.error().msg;
+                buf += " at column ";
+                buf += std::to_string(r.error().offset + 1);
+            }
+            buf += '\n';
+        }
+        if (buf.size() >= kOutChunk) {
+            out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+            buf.clear();
+        }
+    }
+    out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    if (store != nullptr)
+        store->Flush();
+}
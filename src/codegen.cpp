@@ -0,0 +1,334 @@
+// Formula files to C++ headers of inline functions
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#include "codegen.hpp"
+#include "env.hpp"
+#include "sign.hpp"
+
+namespace {
+
+    using expr::Sign;
+
+    // quiet NaN with a payload no lexed constant can carry, plus the index
+    static constexpr uint32_t kParamBits = 0x7fc01000;
+    static constexpr uint32_t kMaxParams = 0x1000;
+
+    // names a formula or variable may not take: the C++ keywords made of
+    // letters and underscores, and the namespace of the helpers
+    static constexpr auto kReserved = std::to_array<std::string_view>({
+        "alignas",   "alignof",    "and",          "and_eq",
+        "asm",       "auto",       "bitand",       "bitor",
+        "bool",      "break",      "case",         "catch",
+        "char",      "class",      "compl",        "concept",
+        "const",     "consteval",  "constexpr",    "constinit",
+        "const_cast", "continue",  "co_await",     "co_return",
+        "co_yield",  "decltype",   "default",      "delete",
+        "detail",    "do",         "double",       "dynamic_cast",
+        "else",      "enum",       "explicit",     "export",
+        "extern",    "false",      "float",        "for",
+        "friend",    "goto",       "if",           "inline",
+        "int",       "long",       "mutable",      "namespace",
+        "new",       "noexcept",   "not",          "not_eq",
+        "nullptr",   "operator",   "or",           "or_eq",
+        "private",   "protected",  "public",       "register",
+        "reinterpret_cast",        "requires",     "return",
+        "short",     "signed",     "sizeof",       "static",
+        "static_assert",           "static_cast",  "struct",
+        "switch",    "template",   "this",         "throw",
+        "true",      "try",        "typedef",      "typeid",
+        "typename",  "union",      "unsigned",     "using",
+        "virtual",   "void",       "volatile",     "while",
+        "xor",       "xor_eq",
+    });
+
+    bool is_reserved(const std::string_view s) {
+        return std::find(kReserved.begin(), kReserved.end(), s) !=
+               kReserved.end();
+    }
+
+    bool is_ident(const std::string_view s) {
+        if (s.empty() || std::isdigit(static_cast<unsigned char>(s[0])))
+            return false;
+        return std::all_of(s.begin(), s.end(), [](const unsigned char c) {
+            return std::isalnum(c) || c == '_';
+        });
+    }
+
+    std::string_view trim(std::string_view s) {
+        while (!s.empty() && std::isspace(static_cast<unsigned char>(s[0])))
+            s.remove_prefix(1);
+        while (!s.empty() &&
+               std::isspace(static_cast<unsigned char>(s.back())))
+            s.remove_suffix(1);
+        return s;
+    }
+
+    [[noreturn]] void fail(const size_t col, const std::string &msg) {
+        throw std::runtime_error("Column " + std::to_string(col + 1) + ": " +
+                                 msg);
+    }
+
+    // C++ literal for a constant, exact: integers in decimal, anything else
+    // as a hexadecimal float
+    std::string literal(const float v) {
+        char buf[64];
+        if (std::isnan(v))
+            return "std::numeric_limits<float>::quiet_NaN()";
+        if (std::isinf(v))
+            return v > 0 ? "std::numeric_limits<float>::infinity()"
+                         : "-std::numeric_limits<float>::infinity()";
+        if (v == std::trunc(v) && std::fabs(v) < 1e9f)
+            std::snprintf(buf, sizeof(buf), "%.1ff", v);
+        else
+            std::snprintf(buf, sizeof(buf), "%af", v);
+        return buf;
+    }
+
+    // The body of one function: a temporary per operator, named after its
+    // instruction so that reading the code follows the program
+    void emit_body(const codegen::Formula &f, std::ostream &out) {
+        std::vector<std::string> stack;
+        const prog::Program &p = f.prog;
+        for (size_t i = 0; i < p.code.size(); ++i) {
+            const prog::Instr &in = p.code[i];
+            if (in.op == static_cast<uint8_t>(Sign::NONE)) {
+                const float v = p.pool[in.arg];
+                const auto bits = std::bit_cast<uint32_t>(v);
+                if (bits >= kParamBits && bits - kParamBits < f.params.size())
+                    stack.push_back(f.params[bits - kParamBits]);
+                else
+                    stack.push_back(literal(v));
+                continue;
+            }
+
+            std::string b;
+            if (expr::sign2optype(in.op) == expr::SignType::OPI) {
+                b = std::move(stack.back());
+                stack.pop_back();
+            }
+            const std::string a = std::move(stack.back());
+            stack.pop_back();
+            std::string e;
+            switch (static_cast<Sign>(in.op)) {
+            case Sign::FCT:
+                e = "std::tgamma(" + a + " + 1)";
+                break;
+            case Sign::LOG:
+                e = "detail::ln(" + a + ")";
+                break;
+            case Sign::ADD:
+                e = a + " + " + b;
+                break;
+            case Sign::SUB:
+                e = a + " - " + b;
+                break;
+            case Sign::MUL:
+                e = a + " * " + b;
+                break;
+            case Sign::DIV:
+                e = a + " / " + b;
+                break;
+            case Sign::EXP:
+                e = "std::pow(" + a + ", " + b + ")";
+                break;
+            case Sign::UAD:
+                stack.push_back(a);
+                continue;
+            case Sign::USB:
+                e = "-" + a;
+                break;
+            case Sign::SIN:
+                e = "std::sin(" + a + ")";
+                break;
+            case Sign::COS:
+                e = "std::cos(" + a + ")";
+                break;
+            case Sign::TAN:
+                e = "std::tan(" + a + ")";
+                break;
+            case Sign::SQT:
+                e = "std::sqrt(" + a + ")";
+                break;
+            case Sign::EXF:
+                e = "std::exp(" + a + ")";
+                break;
+            case Sign::ABS:
+                e = "std::fabs(" + a + ")";
+                break;
+            case Sign::MIN:
+                e = "detail::min(" + a + ", " + b + ")";
+                break;
+            case Sign::MAX:
+                e = "detail::max(" + a + ", " + b + ")";
+                break;
+            default:
+                throw std::runtime_error("Unknown operator");
+            }
+            std::string t = "t";
+            t += std::to_string(i);
+            out << "        const float " << t << " = " << e << ";\n";
+            stack.push_back(t);
+        }
+        out << "        return " << stack.back() << ";\n";
+    }
+
+} // namespace
+
+uint32_t codegen::param_bits(const size_t i) {
+    return kParamBits + static_cast<uint32_t>(i);
+}
+
+codegen::Formula codegen::parse(const std::string &line) {
+    const size_t eq = line.find('=');
+    if (eq == std::string::npos)
+        fail(0, "Expected `name(variables) = expr`");
+
+    Formula f;
+    f.source = std::string(trim(line));
+    const std::string_view lhs(line.data(), eq);
+    const size_t lpar = lhs.find('(');
+    f.name = std::string(trim(lhs.substr(0, lpar)));
+    if (!is_ident(f.name) || is_reserved(f.name))
+        fail(0, "Invalid formula name: `" + f.name + "`");
+
+    env::Env vars;
+    if (lpar != std::string_view::npos) {
+        const size_t rpar = lhs.find(')', lpar);
+        if (rpar == std::string_view::npos ||
+            !trim(lhs.substr(rpar + 1)).empty())
+            fail(lpar, "Expected `)` before `=`");
+        // `name() = expr` has no variables
+        size_t col = lpar + 1;
+        const bool none = trim(lhs.substr(col, rpar - col)).empty();
+        while (!none) {
+            const size_t end = std::min(lhs.find(',', col), rpar);
+            const std::string name(trim(lhs.substr(col, end - col)));
+            if (!env::is_name(name) || is_reserved(name))
+                fail(col, "Invalid variable name: `" + name + "`");
+            if (vars.Find(name) != nullptr)
+                fail(col, "Duplicate variable: `" + name + "`");
+            if (f.params.size() == kMaxParams)
+                fail(col, "Too many variables");
+            vars.Set(name, std::bit_cast<float>(param_bits(f.params.size())));
+            f.params.push_back(name);
+            if (end == rpar)
+                break;
+            col = end + 1;
+        }
+    }
+
+    const std::string rhs = line.substr(eq + 1);
+    auto p = prog::try_compile(rhs.c_str(), &vars);
+    if (!p)
+        fail(eq + 1 + p.error().offset, p.error().msg);
+    f.prog = std::move(p.value());
+    return f;
+}
+
+std::vector<codegen::Formula> codegen::read(std::istream &in) {
+    std::vector<Formula> formulas;
+    std::set<std::string> names;
+    std::string line;
+    for (size_t n = 1; std::getline(in, line); ++n) {
+        const std::string_view s = trim(line);
+        if (s.empty() || s[0] == '#')
+            continue;
+        try {
+            formulas.push_back(parse(line));
+            if (!names.insert(formulas.back().name).second)
+                throw std::runtime_error("Duplicate formula: `" +
+                                         formulas.back().name + "`");
+        } catch (const std::runtime_error &ex) {
+            throw std::runtime_error("Line " + std::to_string(n) + ": " +
+                                     ex.what());
+        }
+    }
+    return formulas;
+}
+
+void codegen::emit(const std::vector<Formula> &formulas, const std::string &ns,
+                   std::ostream &out) {
+    if (!is_ident(ns) || is_reserved(ns))
+        throw std::runtime_error("Invalid namespace: `" + ns + "`");
+
+    out << "// Generated by scicalc_codegen, do not edit\n"
+        << "#pragma once\n\n"
+        << "// `prog::run` rounds every operation to float, so `a * b + c`\n"
+        << "// must not be fused into an FMA: GCC ignores the pragma below\n"
+        << "// and needs -ffp-contract=off, which `scicalc_add_formulas` sets\n"
+        << "#if defined(__clang__) || !defined(__GNUC__)\n"
+        << "#pragma STDC FP_CONTRACT OFF\n"
+        << "#endif\n\n"
+        << "#include <cmath>\n"
+        << "#include <limits>\n\n"
+        << "namespace " << ns << " {\n\n"
+        << "    namespace detail {\n"
+        << "        // `ln` is NaN for non-positive input\n"
+        << "        inline float ln(const float a) {\n"
+        << "            return a > 0 ? std::log(a)\n"
+        << "                         : std::numeric_limits<float>::"
+           "quiet_NaN();\n"
+        << "        }\n"
+        << "        // `min` and `max` are NaN if either input is\n"
+        << "        inline float min(const float a, const float b) {\n"
+        << "            return a < b || a != a ? a : b;\n"
+        << "        }\n"
+        << "        inline float max(const float a, const float b) {\n"
+        << "            return a > b || a != a ? a : b;\n"
+        << "        }\n"
+        << "    } // namespace detail\n";
+
+    for (const auto &f : formulas) {
+        // a variable may not appear in the formula
+        std::vector<bool> used(f.params.size(), false);
+        for (const auto &in : f.prog.code) {
+            if (in.op != static_cast<uint8_t>(Sign::NONE))
+                continue;
+            const auto bits = std::bit_cast<uint32_t>(f.prog.pool[in.arg]);
+            if (bits >= kParamBits && bits - kParamBits < f.params.size())
+                used[bits - kParamBits] = true;
+        }
+
+        out << "\n    // " << f.source << "\n"
+            << "    inline float " << f.name << "(";
+        for (size_t i = 0; i < f.params.size(); ++i)
+            out << (i > 0 ? ", " : "") << (used[i] ? "" : "[[maybe_unused]] ")
+                << "const float " << f.params[i];
+        out << ") {\n";
+        emit_body(f, out);
+        out << "    }\n";
+    }
+    out << "\n} // namespace " << ns << "\n";
+}
+
+void codegen::generate(const std::string &in_path, const std::string &out_path,
+                       const std::string &ns) {
+    std::ifstream ifs(in_path);
+    if (!ifs)
+        throw std::runtime_error("Cannot open formulas: " + in_path);
+    std::ostringstream oss;
+    emit(read(ifs), ns, oss);
+    const std::string text = oss.str();
+
+    // leave the header untouched if nothing changed, so that its users are
+    // not rebuilt
+    std::ifstream old(out_path, std::ios::binary);
+    if (old && std::string(std::istreambuf_iterator<char>(old), {}) == text)
+        return;
+    old.close();
+    std::ofstream ofs(out_path, std::ios::binary | std::ios::trunc);
+    ofs.write(text.data(), static_cast<std::streamsize>(text.size()));
+    if (!ofs)
+        throw std::runtime_error("Cannot write header: " + out_path);
+}
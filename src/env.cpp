@@ -0,0 +1,84 @@
+// Flat symbol table for assignments
+#include <cctype>
+
+#include "env.hpp"
+#include "sign.hpp"
+
+namespace {
+
+    static constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ULL;
+    static constexpr uint64_t kFnvPrime = 0x100000001b3ULL;
+    static constexpr size_t kMinIndex = 16; // power of 2
+
+    uint64_t hash(const std::string_view name) {
+        uint64_t h = kFnvOffset;
+        for (const char c : name) {
+            h ^= static_cast<unsigned char>(c);
+            h *= kFnvPrime;
+        }
+        return h;
+    }
+
+} // namespace
+
+bool env::is_name(std::string_view name) {
+    if (name.empty())
+        return false;
+    for (const char c : name)
+        if (!isalpha(static_cast<unsigned char>(c)))
+            return false;
+    return expr::ident2sign(name.data(), name.size()) ==
+           static_cast<uint8_t>(expr::Sign::NONE);
+}
+
+size_t env::Env::Probe(std::string_view name, uint64_t hash) const {
+    const size_t mask = index_.size() - 1;
+    size_t i = hash & mask;
+    while (index_[i] != 0 && names_[index_[i] - 1] != name)
+        i = (i + 1) & mask;
+    return i;
+}
+
+void env::Env::Grow() {
+    index_.assign(index_.empty() ? kMinIndex : index_.size() * 2, 0);
+    for (size_t k = 0; k < names_.size(); ++k)
+        index_[Probe(names_[k], hash(names_[k]))] =
+            static_cast<uint32_t>(k + 1);
+}
+
+bool env::Env::Set(std::string_view name, float v) {
+    if (!is_name(name))
+        return false;
+    // keep the index at most half full
+    if (2 * (names_.size() + 1) > index_.size())
+        Grow();
+    const size_t i = Probe(name, hash(name));
+    if (index_[i] != 0) {
+        values_[index_[i] - 1] = v;
+        return true;
+    }
+    names_.emplace_back(name);
+    values_.push_back(v);
+    index_[i] = static_cast<uint32_t>(names_.size());
+    return true;
+}
+
+const float *env::Env::Find(std::string_view name) const {
+    if (names_.empty())
+        return nullptr;
+    const size_t i = Probe(name, hash(name));
+    return index_[i] == 0 ? nullptr : &values_[index_[i] - 1];
+}
+
+size_t env::Env::Index(std::string_view name) const {
+    if (names_.empty())
+        return 0;
+    const size_t i = Probe(name, hash(name));
+    return index_[i] == 0 ? names_.size() : index_[i] - 1;
+}
+
+void env::Env::Clear() {
+    names_.clear();
+    values_.clear();
+    index_.clear();
+}
@@ -0,0 +1,357 @@
+// Exact rational evaluation with integer fast paths
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "exact.hpp"
+#include "sign.hpp"
+
+namespace {
+
+    using exact::Value;
+    using expr::Sign;
+
+    // products of two int64 are formed in 128 bits and narrowed afterwards
+    __extension__ typedef __int128 i128;
+    __extension__ typedef unsigned __int128 u128;
+
+    static constexpr u128 kMaxI64 = std::numeric_limits<int64_t>::max();
+    // |INT64_MIN|
+    static constexpr u128 kMagMinI64 = kMaxI64 + 1;
+    // floats at or past 2^63 do not fit in int64
+    static constexpr float kI64Bound = 0x1p63f;
+
+    static constexpr std::array<int64_t, exact::kMaxFct + 1> kMapFct = [] {
+        std::array<int64_t, exact::kMaxFct + 1> t{};
+        t[0] = 1;
+        for (size_t i = 1; i < t.size(); ++i)
+            t[i] = t[i - 1] * static_cast<int64_t>(i);
+        return t;
+    }();
+
+    bool is_infix(const uint8_t op) {
+        const auto [bpl, bpr] = expr::kMapOp2Bp[op - expr::kMinSignOp];
+        return bpl != 0 && bpr != 0;
+    }
+
+    Value inexact(const float v) {
+        return {static_cast<int64_t>(std::bit_cast<uint32_t>(v)), 0};
+    }
+
+    // Evaluate in float, as `prog::run` does
+    Value fallback(const uint8_t op, const Value &a, const Value &b) {
+        return inexact(
+            expr::kMapOp2Fn[op - expr::kMinSignOp](a.ToFloat(), b.ToFloat()));
+    }
+
+    u128 gcd(u128 a, u128 b) {
+        while (b != 0) {
+            const u128 t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    // `num / den` in lowest terms, false if it does not fit in int64
+    bool make(i128 num, i128 den, Value &out) {
+        if (den < 0) {
+            num = -num;
+            den = -den;
+        }
+        const bool neg = num < 0;
+        u128 n = neg ? -static_cast<u128>(num) : static_cast<u128>(num);
+        u128 d = static_cast<u128>(den);
+        // 128-bit division is a library call, stay in 64 bits when possible
+        if ((n >> 64) == 0 && (d >> 64) == 0) {
+            const auto n64 = static_cast<uint64_t>(n);
+            const auto d64 = static_cast<uint64_t>(d);
+            const uint64_t g = std::gcd(n64, d64);
+            n = n64 / g;
+            d = d64 / g;
+        } else {
+            const u128 g = gcd(n, d);
+            n /= g;
+            d /= g;
+        }
+        if (n > (neg ? kMagMinI64 : kMaxI64) || d > kMaxI64)
+            return false;
+        const auto n64 = static_cast<uint64_t>(n);
+        out = {static_cast<int64_t>(neg ? 0 - n64 : n64),
+               static_cast<int64_t>(d)};
+        return true;
+    }
+
+    // `base^e` with e >= 0 by squaring, false on overflow
+    bool ipow(int64_t base, uint64_t e, int64_t &out) {
+        int64_t r = 1;
+        while (true) {
+            if ((e & 1) != 0 && __builtin_mul_overflow(r, base, &r))
+                return false;
+            e >>= 1;
+            if (e == 0)
+                break;
+            if (__builtin_mul_overflow(base, base, &base))
+                return false;
+        }
+        out = r;
+        return true;
+    }
+
+    bool pow(const Value &a, const int64_t e, Value &out) {
+        if (a.num == 0) {
+            if (e < 0)
+                return false; // division by zero, left to float
+            out = Value::Int(e == 0 ? 1 : 0);
+            return true;
+        }
+        if (a.IsInt() && (a.num == 1 || a.num == -1)) {
+            out = Value::Int((e & 1) != 0 ? a.num : 1);
+            return true;
+        }
+        // |a| != 1 overflows past 2^63 either way
+        const uint64_t m = e < 0 ? 0 - static_cast<uint64_t>(e) : e;
+        if (m >= 64)
+            return false;
+        int64_t num = 0;
+        int64_t den = 0;
+        if (!ipow(a.num, m, num) || !ipow(a.den, m, den))
+            return false;
+        // powers of coprime numbers stay coprime
+        if (e >= 0)
+            out = {num, den};
+        else
+            return make(den, num, out);
+        return true;
+    }
+
+    // Value of the number token lexed at `str`: an integer literal within
+    // int64 or a name bound in `env` stays exact, anything else (`pi`, a
+    // decimal, a literal past int64) is the token's float
+    Value literal(const char *str, const float num, const exact::Env *env) {
+        if (isalpha(static_cast<unsigned char>(*str))) {
+            size_t len = 0;
+            while (isalpha(static_cast<unsigned char>(str[len])))
+                ++len;
+            const Value *bound = env != nullptr ? env->Find({str, len})
+                                                : nullptr;
+            return bound != nullptr ? *bound : Value::Real(num);
+        }
+        int64_t v = 0;
+        for (; isdigit(static_cast<unsigned char>(*str)); ++str) {
+            if (__builtin_mul_overflow(v, 10, &v) ||
+                __builtin_add_overflow(v, *str - '0', &v))
+                return Value::Real(num);
+        }
+        return *str == '.' ? Value::Real(num) : Value::Int(v);
+    }
+
+} // namespace
+
+bool exact::Env::Set(std::string_view name, const Value &v) {
+    if (!floats_.Set(name, v.ToFloat()))
+        return false;
+    const size_t i = floats_.Index(name);
+    if (i == values_.size())
+        values_.push_back(v);
+    else
+        values_[i] = v;
+    return true;
+}
+
+const exact::Value *exact::Env::Find(std::string_view name) const {
+    const size_t i = floats_.Index(name);
+    return i < values_.size() ? &values_[i] : nullptr;
+}
+
+Value exact::Value::Real(float v) {
+    if (v == std::trunc(v) && v >= -kI64Bound && v < kI64Bound)
+        return Int(static_cast<int64_t>(v));
+    return inexact(v);
+}
+
+float exact::Value::ToFloat() const {
+    if (den == 1)
+        return static_cast<float>(num);
+    if (den == 0)
+        return std::bit_cast<float>(static_cast<uint32_t>(num));
+    return static_cast<float>(static_cast<double>(num) /
+                              static_cast<double>(den));
+}
+
+std::string exact::Value::ToStr() const {
+    if (den == 1)
+        return std::to_string(num);
+    if (den != 0)
+        return std::to_string(num) + "/" + std::to_string(den);
+    std::ostringstream oss;
+    oss << ToFloat();
+    return oss.str();
+}
+
+exact::Value exact::apply(uint8_t op, const Value &a, const Value &b) {
+    const bool infix = is_infix(op);
+    if (!a.IsExact() || (infix && !b.IsExact()))
+        return fallback(op, a, b);
+
+    Value r;
+    bool ok = true;
+    switch (static_cast<Sign>(op)) {
+    case Sign::ADD:
+    case Sign::SUB:
+        if (a.IsInt() && b.IsInt()) {
+            ok = op == static_cast<uint8_t>(Sign::ADD)
+                     ? !__builtin_add_overflow(a.num, b.num, &r.num)
+                     : !__builtin_sub_overflow(a.num, b.num, &r.num);
+        } else {
+            const i128 l = static_cast<i128>(a.num) * b.den;
+            const i128 rt = static_cast<i128>(b.num) * a.den;
+            ok = make(op == static_cast<uint8_t>(Sign::ADD) ? l + rt : l - rt,
+                      static_cast<i128>(a.den) * b.den, r);
+        }
+        break;
+    case Sign::MUL:
+        if (a.IsInt() && b.IsInt())
+            ok = !__builtin_mul_overflow(a.num, b.num, &r.num);
+        else
+            ok = make(static_cast<i128>(a.num) * b.num,
+                      static_cast<i128>(a.den) * b.den, r);
+        break;
+    case Sign::DIV:
+        ok = b.num != 0 && make(static_cast<i128>(a.num) * b.den,
+                                static_cast<i128>(a.den) * b.num, r);
+        break;
+    case Sign::EXP:
+        ok = b.IsInt() && pow(a, b.num, r);
+        break;
+    case Sign::FCT:
+        ok = a.IsInt() && a.num >= 0 && a.num <= kMaxFct;
+        if (ok)
+            r = Value::Int(kMapFct[a.num]);
+        break;
+    case Sign::LOG:
+        // ln 1 is the only rational logarithm of a rational
+        ok = a.IsInt() && a.num == 1;
+        r = Value::Int(0);
+        break;
+    case Sign::UAD:
+        r = a;
+        break;
+    case Sign::USB:
+        ok = a.num != std::numeric_limits<int64_t>::min();
+        if (ok)
+            r = {-a.num, a.den};
+        break;
+    case Sign::ABS:
+        ok = a.num != std::numeric_limits<int64_t>::min();
+        if (ok)
+            r = {a.num < 0 ? -a.num : a.num, a.den};
+        break;
+    case Sign::SIN:
+    case Sign::TAN:
+        // 0 is the only rational argument with a rational result
+        ok = a.num == 0;
+        r = Value::Int(0);
+        break;
+    case Sign::COS:
+    case Sign::EXF:
+        ok = a.num == 0;
+        r = Value::Int(1);
+        break;
+    case Sign::MIN:
+    case Sign::MAX: {
+        const bool less = static_cast<i128>(a.num) * b.den <
+                          static_cast<i128>(b.num) * a.den;
+        r = less == (op == static_cast<uint8_t>(Sign::MIN)) ? a : b;
+        break;
+    }
+    default:
+        ok = false;
+        break;
+    }
+    return ok ? r : fallback(op, a, b);
+}
+
+exact::Value exact::run(const prog::View &v) {
+    return exact::run(v, nullptr);
+}
+
+exact::Value exact::run(const prog::View &v, const Value *pool) {
+    thread_local std::vector<Value> stack;
+    if (stack.size() < v.depth)
+        stack.resize(v.depth);
+
+    Value *top = stack.data(); // one past the top
+    for (uint32_t i = 0; i < v.size; ++i) {
+        const prog::Instr &in = v.code[i];
+        if (in.op == static_cast<uint8_t>(Sign::NONE)) {
+            *top++ = pool != nullptr ? pool[in.arg]
+                                     : Value::Real(v.pool[in.arg]);
+            continue;
+        }
+        if (is_infix(in.op)) {
+            --top;
+            Value &a = top[-1];
+            // integer +, - and * without leaving the loop
+            if (a.IsInt() && top->IsInt()) {
+                int64_t r = 0;
+                bool ok = false;
+                switch (static_cast<Sign>(in.op)) {
+                case Sign::ADD:
+                    ok = !__builtin_add_overflow(a.num, top->num, &r);
+                    break;
+                case Sign::SUB:
+                    ok = !__builtin_sub_overflow(a.num, top->num, &r);
+                    break;
+                case Sign::MUL:
+                    ok = !__builtin_mul_overflow(a.num, top->num, &r);
+                    break;
+                default:
+                    break;
+                }
+                if (ok) {
+                    a.num = r;
+                    continue;
+                }
+            }
+            a = apply(in.op, a, *top);
+        } else {
+            top[-1] = apply(in.op, top[-1], Value{});
+        }
+    }
+    return stack[0];
+}
+
+expr::Expected<exact::Value> exact::try_eval(const char *str,
+                                             const Env *env) {
+    std::vector<expr::Token> tokens;
+    std::vector<uint32_t> offsets;
+    const auto err = expr::lex(str, tokens, offsets,
+                               env != nullptr ? &env->Floats() : nullptr);
+    if (err.code != expr::Errc::OK)
+        return err;
+    const auto p = prog::try_compile(tokens, offsets);
+    if (!p)
+        return p.error();
+    // the pool takes the number tokens in order
+    std::vector<Value> pool;
+    pool.reserve(p.value().pool.size());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (!tokens[i].isop)
+            pool.push_back(literal(str + offsets[i], tokens[i].num, env));
+    }
+    return exact::run(p.value().view(), pool.data());
+}
+
+exact::Value exact::eval(const char *str, const Env *env) {
+    auto v = try_eval(str, env);
+    if (!v)
+        throw std::runtime_error(v.error().msg);
+    return v.value();
+}
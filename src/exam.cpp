@@ -1,17 +1,46 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <random>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
 #include "exam.hpp"
+#include "pool.hpp"
+#include "prog.hpp"
+#include "sign.hpp"
 
 namespace {
     static constexpr uint8_t kNOpUnary = 3;
     static constexpr uint8_t kNOpInfix = 6;
 
+    // quizzes whose answer is not finite are redrawn up to this many times
+    static constexpr int kMaxDraws = 64;
+
+    // Offsets of the string offsets and of the text in a sheet of `n`
+    // quizzes: the answer keys are followed by 8-byte aligned offsets.
+    // False if they do not fit in `size_t`
+    bool sheet_layout(const size_t n, size_t &off_offsets, size_t &off_str) {
+        size_t keys = 0;
+        size_t offsets = 0;
+        if (__builtin_mul_overflow(n, sizeof(float), &keys) ||
+            __builtin_add_overflow(keys, sizeof(exam::SheetHeader) + 7,
+                                   &off_offsets) ||
+            __builtin_add_overflow(n, 1, &offsets) ||
+            __builtin_mul_overflow(offsets, sizeof(uint64_t), &offsets))
+            return false;
+        off_offsets &= ~size_t(7);
+        return !__builtin_add_overflow(off_offsets, offsets, &off_str);
+    }
+
     enum class OpInfix {
         NONE = 0,
         ADD,
@@ -172,16 +201,17 @@ namespace {
     // @param n         Number of operands (before any combinations)
     // @param min_opd   Minimum value of operands
     // @param max_opd   Maximum value of operands
+    // @param gen       Random engine to draw from
     // @return          A complex expression string suitable for evaluation
     std::string
     fns2str(const uint8_t n, const int min_opd, const int max_opd,
             const std::vector<char> &ops_infix,
             const std::vector<std::string (*)(const std::string &)> &fns_opu1,
-            const std::vector<std::string (*)(const std::string &)> &fns_opu) {
+            const std::vector<std::string (*)(const std::string &)> &fns_opu,
+            std::mt19937 &gen) {
         if (n < 1)
             throw std::invalid_argument("Number of operands must be >= 1");
 
-        std::mt19937 gen(std::random_device{}());
         std::uniform_int_distribution<> dist_opd(min_opd, max_opd);
         std::uniform_int_distribution<> idx_u1(0, fns_opu1.size() - 1);
         std::uniform_int_distribution<> idx_unary(0, fns_opu.size() - 1);
@@ -227,8 +257,273 @@ namespace {
 
 std::string exam::rand_expr(const std::string &s, const uint8_t n_opd,
                             const int min_opd, const int max_opd) {
+    std::mt19937 gen(std::random_device{}());
+    return Generator(s, n_opd, min_opd, max_opd).Expr(gen);
+}
+
+exam::Generator::Generator(const std::string &s, const uint8_t n_opd,
+                           const int min_opd, const int max_opd)
+    : n_opd_(n_opd), min_opd_(min_opd), max_opd_(max_opd) {
     auto [ops_infix, ops_unary] = get_op_pool(s);
-    auto [fns_opu, fns_opu1] = pool_fn_opu(ops_unary);
-    auto ops_infix_c = poot_s_opi(ops_infix);
-    return fns2str(n_opd, min_opd, max_opd, ops_infix_c, fns_opu1, fns_opu);
+    std::tie(fns_opu_, fns_opu1_) = pool_fn_opu(ops_unary);
+    ops_infix_ = poot_s_opi(ops_infix);
+    if (ops_infix_.empty())
+        throw std::invalid_argument("At least one infix operator is required");
+}
+
+std::string exam::Generator::Expr(std::mt19937 &gen) const {
+    return fns2str(n_opd_, min_opd_, max_opd_, ops_infix_, fns_opu1_, fns_opu_,
+                   gen);
+}
+
+exam::Quiz exam::Generator::Draw(std::mt19937 &gen) const {
+    Quiz q;
+    for (int i = 0; i < kMaxDraws; ++i) {
+        q.expr = Expr(gen);
+        const auto ans = prog::try_eval(q.expr.c_str());
+        q.ans = ans.value_or(expr::kFNan);
+        if (std::isfinite(q.ans))
+            return q;
+    }
+    throw std::runtime_error("Cannot draw a quiz with a finite answer");
+}
+
+exam::Session::Session(const Generator &g, const size_t n,
+                       const uint64_t seed, const size_t depth)
+    : g_(g), n_(n), depth_(std::max<size_t>(depth, 1)) {
+    std::seed_seq ss{static_cast<uint32_t>(seed),
+                     static_cast<uint32_t>(seed >> 32)};
+    gen_.seed(ss);
+    thread_ = std::thread([this] { Produce(); });
+}
+
+exam::Session::~Session() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        stop_ = true;
+    }
+    cv_space_.notify_one();
+    thread_.join();
+}
+
+void exam::Session::Produce() {
+    for (size_t i = 0; i < n_; ++i) {
+        // drawn outside the lock, while the user answers
+        Quiz q;
+        std::string err;
+        try {
+            q = g_.Draw(gen_);
+        } catch (const std::exception &ex) {
+            err = ex.what();
+        }
+
+        std::unique_lock<std::mutex> lk(mtx_);
+        if (!err.empty()) {
+            err_ = std::move(err);
+            lk.unlock();
+            cv_ready_.notify_one();
+            return;
+        }
+        cv_space_.wait(lk, [&] { return stop_ || queue_.size() < depth_; });
+        if (stop_)
+            return;
+        queue_.push_back(std::move(q));
+        lk.unlock();
+        cv_ready_.notify_one();
+    }
+}
+
+exam::Quiz exam::Session::Next() {
+    std::unique_lock<std::mutex> lk(mtx_);
+    if (n_taken_ == n_)
+        throw std::out_of_range("No more quizzes");
+    cv_ready_.wait(lk, [&] { return !queue_.empty() || !err_.empty(); });
+    if (queue_.empty())
+        throw std::runtime_error(err_);
+    Quiz q = std::move(queue_.front());
+    queue_.pop_front();
+    ++n_taken_;
+    lk.unlock();
+    cv_space_.notify_one();
+    return q;
+}
+
+exam::Stats exam::generate(const std::string &path, const Generator &g,
+                           const uint32_t n_exam, const uint32_t n_quiz,
+                           const uint64_t seed) {
+    const auto t0 = std::chrono::steady_clock::now();
+    const size_t n = static_cast<size_t>(n_exam) * n_quiz;
+    std::vector<std::string> exprs(n);
+    std::vector<float> key(n);
+
+    // one engine per exam so that the output does not depend on the
+    // number of threads; the pool does not carry exceptions
+    std::atomic<bool> failed{false};
+    pool::shared().For(n_exam, 1, [&](size_t begin, size_t end) {
+        for (size_t e = begin; e < end && !failed; ++e) {
+            std::seed_seq ss{static_cast<uint32_t>(seed),
+                             static_cast<uint32_t>(seed >> 32),
+                             static_cast<uint32_t>(e)};
+            std::mt19937 gen(ss);
+            try {
+                for (size_t i = e * n_quiz; i < (e + 1) * n_quiz; ++i) {
+                    auto q = g.Draw(gen);
+                    exprs[i] = std::move(q.expr);
+                    key[i] = q.ans;
+                }
+            } catch (const std::exception &) {
+                failed = true;
+            }
+        }
+    });
+    if (failed)
+        throw std::runtime_error("Cannot draw a quiz with a finite answer");
+    size_t off_offsets = 0;
+    size_t off_str = 0;
+    if (!sheet_layout(n, off_offsets, off_str))
+        throw std::runtime_error("Too many quizzes for a sheet");
+
+    std::vector<uint64_t> offsets(n + 1, 0);
+    for (size_t i = 0; i < n; ++i)
+        offsets[i + 1] = offsets[i] + exprs[i].size();
+
+    SheetHeader hdr{};
+    std::memcpy(hdr.magic, kSheetMagic, sizeof(kSheetMagic));
+    hdr.version = kSheetVersion;
+    hdr.endian = kSheetEndian;
+    hdr.n_exam = n_exam;
+    hdr.n_quiz = n_quiz;
+    hdr.n_str = offsets[n];
+
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs)
+        throw std::runtime_error("Cannot open sheet for writing: " + path);
+    static constexpr char kPad[8] = {0};
+    ofs.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    ofs.write(reinterpret_cast<const char *>(key.data()), n * sizeof(float));
+    ofs.write(kPad, off_offsets - sizeof(hdr) - n * sizeof(float));
+    ofs.write(reinterpret_cast<const char *>(offsets.data()),
+              (n + 1) * sizeof(uint64_t));
+    for (const auto &s : exprs)
+        ofs.write(s.data(), static_cast<std::streamsize>(s.size()));
+    if (!ofs)
+        throw std::runtime_error("Failed to write sheet: " + path);
+
+    const std::chrono::duration<double> dt =
+        std::chrono::steady_clock::now() - t0;
+    return {n, dt.count()};
+}
+
+exam::Sheet::Sheet(const std::string &path) : file_(path) {
+    const char *p = file_.Data();
+    if (file_.Size() < sizeof(SheetHeader))
+        throw std::runtime_error("Truncated sheet: " + path);
+    hdr_ = reinterpret_cast<const SheetHeader *>(p);
+    if (std::memcmp(hdr_->magic, kSheetMagic, sizeof(kSheetMagic)) != 0 ||
+        hdr_->endian != kSheetEndian || hdr_->version != kSheetVersion)
+        throw std::runtime_error("Not an exam sheet: " + path);
+
+    const size_t n = Size();
+    size_t off_offsets = 0;
+    size_t off_str = 0;
+    if (!sheet_layout(n, off_offsets, off_str) || file_.Size() < off_str)
+        throw std::runtime_error("Truncated sheet: " + path);
+    key_ = reinterpret_cast<const float *>(p + sizeof(SheetHeader));
+    offsets_ = reinterpret_cast<const uint64_t *>(p + off_offsets);
+    str_ = p + off_str;
+    if (offsets_[n] != hdr_->n_str || file_.Size() - off_str < hdr_->n_str)
+        throw std::runtime_error("Truncated sheet: " + path);
+    // `Expr` trusts the offsets, which must not decrease nor pass the text
+    for (size_t i = 0; i < n; ++i)
+        if (offsets_[i] > offsets_[i + 1])
+            throw std::runtime_error("Corrupted sheet offsets: " + path);
+}
+
+std::string_view exam::Sheet::Expr(const size_t i) const {
+    return {str_ + offsets_[i], offsets_[i + 1] - offsets_[i]};
+}
+
+void exam::Sheet::Print(std::ostream &os) const {
+    for (uint32_t e = 0; e < NExam(); ++e) {
+        os << "Exam " << e << "\n";
+        for (uint32_t i = 0; i < NQuiz(); ++i)
+            os << "  " << (i + 1) << ". " << Expr(e * NQuiz() + i) << " =\n";
+    }
+}
+
+// Lines of the answer file are `<student> <exam> <answer>...`, scores are
+// written as `<student> <score> <n_quiz>`, or `<student> invalid` if the
+// exam index is out of range
+exam::Stats exam::grade(const std::string &path_sheet,
+                        const std::string &path_ans,
+                        const std::string &path_out) {
+    static constexpr size_t kLinesChunk = 1 << 16;
+    static constexpr long kInvalid = -1;
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const Sheet sheet(path_sheet);
+    std::ifstream ifs(path_ans);
+    if (!ifs)
+        throw std::runtime_error("Cannot open answer file: " + path_ans);
+    std::ofstream ofs(path_out, std::ios::trunc);
+    if (!ofs)
+        throw std::runtime_error("Cannot open score file: " + path_out);
+
+    std::vector<std::string> lines(kLinesChunk);
+    std::vector<std::string> students(kLinesChunk);
+    std::vector<long> scores(kLinesChunk);
+    size_t n_quiz = 0;
+    while (ifs) {
+        size_t n_lines = 0;
+        while (n_lines < kLinesChunk && std::getline(ifs, lines[n_lines]))
+            if (!lines[n_lines].empty())
+                ++n_lines;
+
+        pool::shared().For(n_lines, 256, [&](size_t begin, size_t end) {
+            for (size_t l = begin; l < end; ++l) {
+                const char *p = lines[l].c_str();
+                char *q;
+                while (isspace(*p))
+                    ++p;
+                const char *s = p;
+                while (*p && !isspace(*p))
+                    ++p;
+                students[l].assign(s, p);
+
+                const long e = std::strtol(p, &q, 10);
+                if (q == p || e < 0 || e >= sheet.NExam()) {
+                    scores[l] = kInvalid;
+                    continue;
+                }
+                long score = 0;
+                p = q;
+                for (uint32_t i = 0; i < sheet.NQuiz(); ++i) {
+                    const float ans = std::strtof(p, &q);
+                    if (q == p)
+                        break; // missing answers are wrong
+                    p = q;
+                    if (std::abs(ans - sheet.Key(e * sheet.NQuiz() + i)) <
+                        kEpsilon)
+                        ++score;
+                }
+                scores[l] = score;
+            }
+        });
+
+        for (size_t l = 0; l < n_lines; ++l) {
+            if (scores[l] == kInvalid) {
+                ofs << students[l] << " invalid\n";
+            } else {
+                ofs << students[l] << ' ' << scores[l] << ' '
+                    << sheet.NQuiz() << '\n';
+                n_quiz += sheet.NQuiz();
+            }
+        }
+    }
+    if (!ofs)
+        throw std::runtime_error("Failed to write scores: " + path_out);
+
+    const std::chrono::duration<double> dt =
+        std::chrono::steady_clock::now() - t0;
+    return {n_quiz, dt.count()};
 }
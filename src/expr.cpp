@@ -2,169 +2,36 @@
 #include <array>
 #include <cmath>
 #include <cstring>
-#include <limits>
-#include <unordered_map>
+#include <stdexcept>
 
+#include "env.hpp"
 #include "expr.hpp"
+#include "sign.hpp"
 
 namespace {
 
-    static constexpr float kFNan = std::numeric_limits<float>::quiet_NaN();
-    static constexpr float kFDummy = 0.0f;
-
-    // binding power delta for parenthesis
-    static constexpr int8_t kBpDelta = 10;
-
-    // start of helpers
-    static constexpr uint8_t kMinSignHelper = 1;
-    // start of constants
-    static constexpr uint8_t kMinSignConst = 21;
-    // start of operators (unary / binary associative)
-    static constexpr uint8_t kMinSignOp = 101;
-    static constexpr uint8_t kOpSize = 9;
-
-    // Both operatoers (left, right and infix) and helpers (parentheses)
-    // used by `Atom.value`
-    //
-    // NOTE:
-    // - when adding new operators, make sure to update
-    //   - `kOpSize`
-    //   - `kMapOp2Fn`
-    //   - `kMapOp2Bp`
-    // - adding constants: update `kMapConst2Real`
-    enum class Sign : uint8_t {
-        NONE = 0,
-        // helpers
-        PAL = kMinSignHelper, // (
-        PAR,                  // )
-        // constants
-        PI = kMinSignConst, // pi
-        E,                  // e
-        // operators, size = kOpSize
-        FCT = kMinSignOp, // factorial (left associative)
-        LOG,              // log (right associative)
-        ADD,              // +
-        SUB,              // -
-        MUL,              // *
-        DIV,              // /
-        EXP,              // ^
-        UAD,              // unary add (right associative)
-        USB,              // unary sub (right associative)
-    };
-
-    enum class SignType : uint8_t {
-        NONE = 0,
-        CON = 1, // constant
-        OPL = 2, // left associative unary operator e.g. !
-        OPR = 3, // right associative unary operator e.g. ln
-        OPI = 4, // infix operator
-    };
-
-    // map constant signs
-    static constexpr std::array<float, 2> kMapConst2Real{
-        3.14159265358979323846f, // PI (kMinSignConst)
-        2.71828182845904523536f, // E
-    };
-
-    // map Operator to function
-    static const std::array<float (*)(const float, const float), kOpSize>
-        kMapOp2Fn{
-            // factorial (kMinSignOp)
-            [](float a, float) { return std::tgamma(a + 1); }, 
-            // log, exclude 0 and negative values
-            [](float a, float) { return (a > 0) ? std::log(a) : kFNan; },
-            [](float a, float b) { return a + b; }, 
-            [](float a, float b) { return a - b; }, // SUB
-            [](float a, float b) { return a * b; }, // MUL
-            [](float a, float b) { return a / b; }, // DIV
-            [](float a, float b) { return std::pow(a, b); }, // EXP
-            [](float a, float) { return a; },                // UAD
-            [](float a, float) { return -a; },               // USB
-        };
-
-    static constexpr std::array<std::pair<uint8_t, uint8_t>, kOpSize> kMapOp2Bp{
-        std::make_pair(6, 0), // factorial (kMinSignOp)
-        std::make_pair(0, 5), // log
-        std::make_pair(1, 1), // +
-        std::make_pair(1, 1), // -
-        std::make_pair(2, 2), // *
-        std::make_pair(2, 2), // /
-        std::make_pair(4, 3), // left-skewed
-        std::make_pair(0, 1), // unary add
-        std::make_pair(0, 1), // unary sub
-    };
-
-    // Binding power for operators
-    static std::pair<uint8_t, uint8_t> get_bp(uint8_t op) {
-        try {
-            return kMapOp2Bp.at(op - kMinSignOp);
-        } catch (const std::out_of_range &) {
-            throw std::runtime_error("Unknown operator");
-        }
-    }
+    using expr::Sign;
+    using expr::SignType;
 
-    static constexpr SignType sign2optype(const uint8_t op) {
-        if (op >= kMinSignOp) {
-            auto [bpl, bpr] = get_bp(op);
-
-            if (bpl == 0 && bpr == 0)
-                return SignType::NONE;
-            if (bpl == 0)
-                return SignType::OPR;
-            if (bpr == 0)
-                return SignType::OPL;
-            return SignType::OPI;
-        }
-
-        if (op >= kMinSignConst)
-            return SignType::CON;
-        return SignType::NONE;
-    }
+    // limits of `lex` without a budget
+    static constexpr expr::Budget kNoBudget{};
 
     float digit2int(const char *str) {
-        float value = 0;
-        float decimal = 0.1f;
-        bool is_decimal = false;
-
-        while (*str) {
-            if (*str == '.') {
-                is_decimal = true;
-                str++;
-            }
-
-            if (is_decimal) {
-                value += (*str - '0') * decimal;
-                decimal *= 0.1f;
-            } else {
-                value = value * 10 + (*str - '0');
-            }
-            str++;
-        }
-        return value;
+        return expr::digits2num(str, strlen(str));
     }
 
     uint8_t alpha2sign(const char *str) {
-        if (strncmp(str, "ln", 2) == 0) {
-            return static_cast<uint8_t>(Sign::LOG);
-        } else if (strncmp(str, "pi", 2) == 0) {
-            return static_cast<uint8_t>(Sign::PI);
-        } else if (strncmp(str, "e", 1) == 0) {
-            return static_cast<uint8_t>(Sign::E);
-        }
-        throw std::runtime_error("Unknown function");
+        const uint8_t sign = expr::ident2sign(str, strlen(str));
+        if (sign == static_cast<uint8_t>(Sign::NONE))
+            throw std::runtime_error("Unknown function");
+        return sign;
     }
 
-    static const std::unordered_map<char, Sign> kMapChar2Sign{
-        {'!', Sign::FCT}, {'+', Sign::ADD}, {'-', Sign::SUB}, {'*', Sign::MUL},
-        {'/', Sign::DIV}, {'^', Sign::EXP}, {'(', Sign::PAL}, {')', Sign::PAR},
-    };
-
     uint8_t char2sign(const char c) {
-        try {
-            return static_cast<uint8_t>(kMapChar2Sign.at(c));
-        } catch (const std::out_of_range &) {
+        const uint8_t sign = expr::chr2sign(c);
+        if (sign == static_cast<uint8_t>(Sign::NONE))
             throw std::runtime_error("Unknown operator");
-        }
+        return sign;
     }
 
     enum class ChainState : uint8_t {
@@ -191,6 +58,34 @@ namespace {
         return static_cast<ChainState>(head->state);
     }
 
+    // true if the node holds its left operand. NaN is a valid operand, e.g.
+    // `ln 0`, so this follows the state rather than the value
+    bool has_lhs(const expr::Chain &c) {
+        switch (static_cast<ChainState>(c.state)) {
+        case ChainState::LHS_NUL_NUL:
+        case ChainState::LHS_OPL_NUL:
+        case ChainState::LHS_OPL_RHS:
+        case ChainState::LHS_OPI_RHS:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // state of a node once `reduce` stored an operand into its LHS
+    uint8_t with_lhs(const uint8_t state) {
+        switch (static_cast<ChainState>(state)) {
+        case ChainState::NUL_OPL_NUL:
+            return static_cast<uint8_t>(ChainState::LHS_OPL_NUL);
+        case ChainState::NUL_OPL_RHS:
+            return static_cast<uint8_t>(ChainState::LHS_OPL_RHS);
+        case ChainState::NUL_OPI_RHS:
+            return static_cast<uint8_t>(ChainState::LHS_OPI_RHS);
+        default:
+            return state;
+        }
+    }
+
     static constexpr std::array<bool, 9> kMapChain2NoMod{
         true,  // NUL
         true,  // LHS_NUL_NUL
@@ -257,6 +152,139 @@ std::vector<char *> expr::split_str(const char *str) {
     return tokens;
 }
 
+// Single pass over the string without allocating lexemes. Unknown symbols
+// are reported before any parenthesis error, matching the order in which
+// `chrs2atoms` and `atoms2tokens` run
+expr::Error expr::lex(const char *str, std::vector<Token> &tokens,
+                      std::vector<uint32_t> &offsets, const env::Env *env,
+                      const Budget *budget) {
+    tokens.clear();
+    offsets.clear();
+    const Budget &b = budget != nullptr ? *budget : kNoBudget;
+    if (budget != nullptr && b.max_len < UINT64_MAX &&
+        strnlen(str, b.max_len + 1) > b.max_len)
+        return {Errc::TOO_LONG, b.max_len, "Input too long"};
+
+    Error err_par;
+    uint8_t lpar = 0;   // left parenthesis count
+    uint32_t depth = 0; // same, without wrapping around
+    uint64_t n_lexeme = 0;
+    bool first = true;
+    Calls calls;
+    const char *start = str;
+
+    while (*start) {
+        while (isspace(*start))
+            start++; // Skip whitespace
+        if (*start == '\0')
+            break;
+
+        const char *end = start;
+        const auto off = static_cast<uint32_t>(start - str);
+        uint8_t sign;
+        const float *bound = nullptr; // value of a bound identifier
+
+        if (++n_lexeme > b.max_tokens)
+            return {Errc::TOO_MANY_TOKENS, off, "Too many tokens"};
+        if (budget != nullptr && n_lexeme % kBudgetPoll == 0) {
+            if (const Error err = b.Poll(off); err.code != Errc::OK)
+                return err;
+        }
+
+        if (isdigit(*start)) {
+            while (isdigit(*end) || *end == '.')
+                end++;
+            sign = static_cast<uint8_t>(Sign::NONE);
+        } else if (*start == '.' && isdigit(*(start + 1))) {
+            // a number, but `chrs2atoms` only accepts leading digits
+            return {Errc::UNKNOWN_OP, off, "Unknown operator"};
+        } else if (isalpha(*start)) {
+            while (isalpha(*end))
+                end++;
+            sign = ident2sign(start, end - start);
+            if (sign == static_cast<uint8_t>(Sign::NONE) && env != nullptr)
+                bound = env->Find({start, static_cast<size_t>(end - start)});
+            if (sign == static_cast<uint8_t>(Sign::NONE) && bound == nullptr)
+                return {Errc::UNKNOWN_FN, off, "Unknown function"};
+        } else {
+            end++;
+            sign = chr2sign(*start);
+            if (sign == static_cast<uint8_t>(Sign::NONE))
+                return {Errc::UNKNOWN_OP, off, "Unknown operator"};
+        }
+
+        // Change the starting + or - sign to unary
+        if (first && sign == static_cast<uint8_t>(Sign::SUB))
+            sign = static_cast<uint8_t>(Sign::USB);
+        else if (first && sign == static_cast<uint8_t>(Sign::ADD))
+            sign = static_cast<uint8_t>(Sign::UAD);
+        first = false;
+        start = end;
+
+        if (err_par.code != Errc::OK)
+            continue; // only looking for unknown symbols from here on
+        if (calls.Pending() && sign != static_cast<uint8_t>(Sign::PAL)) {
+            err_par = {Errc::BAD_CALL, off, "Misplaced call or comma"};
+            continue;
+        }
+        if (bound != nullptr) {
+            tokens.emplace_back(*bound);
+        } else if (sign == static_cast<uint8_t>(Sign::NONE)) {
+            const int val = digits2num(str + off, end - str - off);
+            tokens.emplace_back(static_cast<float>(val));
+        } else if (sign2optype(sign) == SignType::CON) {
+            tokens.emplace_back(kMapConst2Real[sign - kMinSignConst]);
+        } else if (sign == static_cast<uint8_t>(Sign::PAL)) {
+            if (++depth > b.max_depth)
+                return {Errc::TOO_DEEP, off, "Nesting too deep"};
+            calls.Enter(++lpar);
+            continue;
+        } else if (sign == static_cast<uint8_t>(Sign::PAR)) {
+            if (lpar == 0) {
+                err_par = {Errc::UNMATCHED_RPAR, off,
+                           "Unmatched right parenthesis"};
+            } else if (!calls.Leave(lpar)) {
+                err_par = {Errc::BAD_CALL, off, "Misplaced call or comma"};
+            } else {
+                --lpar;
+                --depth;
+            }
+            continue;
+        } else if (is_call(sign)) {
+            calls.Open(sign); // only its `,` are tokens
+            continue;
+        } else if (sign == static_cast<uint8_t>(Sign::CMA)) {
+            sign = calls.Comma(lpar);
+            if (sign == static_cast<uint8_t>(Sign::NONE)) {
+                err_par = {Errc::BAD_CALL, off, "Misplaced call or comma"};
+                continue;
+            }
+            // binds as the call's operator one level out
+            const auto [bpl, bpr] = kMapOp2Bp[sign - kMinSignOp];
+            tokens.emplace_back(sign, bpl + (lpar - 1) * kBpDelta,
+                                bpr + (lpar - 1) * kBpDelta);
+        } else {
+            auto [bpl, bpr] = kMapOp2Bp[sign - kMinSignOp];
+            bpl = (bpl == 0) ? 0 : bpl + lpar * kBpDelta;
+            bpr = (bpr == 0) ? 0 : bpr + lpar * kBpDelta;
+            tokens.emplace_back(sign, bpl, bpr);
+        }
+        offsets.push_back(off);
+    }
+
+    if (first)
+        return {Errc::EMPTY_STRING, 0, "Empty string"};
+    if (err_par.code != Errc::OK)
+        return err_par;
+    if (calls.Pending())
+        return {Errc::BAD_CALL, static_cast<uint32_t>(start - str),
+                "Misplaced call or comma"};
+    if (lpar > 0)
+        return {Errc::UNMATCHED_LPAR, static_cast<uint32_t>(start - str),
+                "Unmatched left parenthesis"};
+    return {};
+}
+
 // Free the memory allocated for the strings in the vector
 void expr::free_chrs(std::vector<char *> &chrs) {
     for (auto &chr : chrs) {
@@ -301,8 +329,12 @@ std::vector<expr::Token>
 expr::atoms2tokens(const std::vector<expr::Atom> &pairs) {
     std::vector<expr::Token> tokens;
     uint8_t lpar = 0; // left parenthesis count
+    Calls calls;
 
     for (const auto &pair : pairs) {
+        if (calls.Pending() &&
+            !(pair.sign && pair.value == static_cast<int>(Sign::PAL)))
+            throw std::runtime_error("Misplaced call or comma");
         if (!pair.sign) {
             tokens.emplace_back(pair.value);
         } else if (pair.sign && sign2optype(static_cast<uint8_t>(pair.value)) ==
@@ -311,11 +343,24 @@ expr::atoms2tokens(const std::vector<expr::Atom> &pairs) {
             const float val = kMapConst2Real[pair.value - kMinSignConst];
             tokens.emplace_back(val);
         } else if (pair.sign && pair.value == static_cast<int>(Sign::PAL)) {
-            ++lpar;
+            calls.Enter(++lpar);
         } else if (pair.sign && pair.value == static_cast<int>(Sign::PAR)) {
             if (lpar == 0)
                 throw std::runtime_error("Unmatched right parenthesis");
+            if (!calls.Leave(lpar))
+                throw std::runtime_error("Misplaced call or comma");
             --lpar;
+        } else if (pair.sign && is_call(static_cast<uint8_t>(pair.value))) {
+            calls.Open(static_cast<uint8_t>(pair.value));
+        } else if (pair.sign && pair.value == static_cast<int>(Sign::CMA)) {
+            const uint8_t op = calls.Comma(lpar);
+            if (op == static_cast<uint8_t>(Sign::NONE))
+                throw std::runtime_error("Misplaced call or comma");
+            // binds as the call's operator one level out
+            const auto [bpl, bpr] = get_bp(op);
+            tokens.emplace_back(op,
+                                bpl + (lpar - 1) * kBpDelta,
+                                bpr + (lpar - 1) * kBpDelta);
         } else {
             auto [bpl, bpr] = get_bp(pair.value);
             // OPR will always have 0 left binding power
@@ -325,6 +370,8 @@ expr::atoms2tokens(const std::vector<expr::Atom> &pairs) {
             tokens.emplace_back(pair.value, bpl, bpr);
         }
     }
+    if (calls.Pending())
+        throw std::runtime_error("Misplaced call or comma");
     if (lpar > 0)
         throw std::runtime_error("Unmatched left parenthesis");
     return tokens;
@@ -446,21 +493,45 @@ float expr::Chain::Step() const {
         return kMapOp2Fn[op - kMinSignOp](lhs, kFDummy);
     }
     if (rbp >= rhs->lbp && sign2optype(op) == SignType::OPR &&
-        !std::isnan(rhs->lhs)) {
+        has_lhs(*rhs)) {
         return kMapOp2Fn[op - kMinSignOp](rhs->lhs, kFDummy);
     }
     if (rbp >= rhs->lbp && sign2optype(op) == SignType::OPI &&
-        !std::isnan(lhs) && !std::isnan(rhs->lhs)) {
+        has_lhs(*this) && has_lhs(*rhs)) {
         return kMapOp2Fn[op - kMinSignOp](lhs, rhs->lhs);
     }
-    if (lbp >= 0 && sign2optype(op) == SignType::OPL && !std::isnan(lhs)) {
+    if (lbp >= 0 && sign2optype(op) == SignType::OPL && has_lhs(*this)) {
         return kMapOp2Fn[op - kMinSignOp](lhs, kFDummy);
     }
     throw std::runtime_error("Invalid chain: cannot step");
 }
 
+namespace {
+
+    // `expr::reduce`, polling `budget` every `kBudgetPoll` nodes counted in
+    // `visited`: a reduction walks the chain until a node can step
+    std::shared_ptr<expr::Chain>
+    reduce_polled(const std::shared_ptr<expr::Chain> &car,
+                  const expr::Budget &budget, uint64_t &visited) {
+        if (visited++ % expr::kBudgetPoll == 0) {
+            if (const expr::Error err = budget.Poll(0);
+                err.code != expr::Errc::OK)
+                throw std::runtime_error(err.msg);
+        }
+        return expr::reduce(car, budget, visited);
+    }
+
+} // namespace
+
 std::shared_ptr<expr::Chain>
 expr::reduce(const std::shared_ptr<expr::Chain> &car) {
+    uint64_t visited = 0;
+    return reduce(car, kNoBudget, visited);
+}
+
+std::shared_ptr<expr::Chain>
+expr::reduce(const std::shared_ptr<expr::Chain> &car, const Budget &budget,
+             uint64_t &visited) {
     if (car->rhs == nullptr && sign2optype(car->op) == SignType::NONE) {
         return car;
     }
@@ -472,23 +543,18 @@ expr::reduce(const std::shared_ptr<expr::Chain> &car) {
     auto cdr = car->rhs;
     try {
         cdr->lhs = car->Step();
+        cdr->state = with_lhs(cdr->state);
         return cdr;
     } catch (const std::runtime_error &) {
+        // thrown from the handler, a budget error leaves through every level
         auto c = expr::Chain(car->state, car->op, car->lbp, car->rbp, car->lhs,
-                             reduce(cdr));
+                             reduce_polled(cdr, budget, visited));
         return std::make_shared<expr::Chain>(c);
     }
 }
 
 float expr::eval(const std::shared_ptr<Chain> &chain) {
-    auto c = chain;
-    while (true) {
-        if (c->rhs == nullptr && sign2optype(c->op) == SignType::NONE) {
-            break;
-        }
-        c = reduce(c);
-    }
-    return c->lhs;
+    return eval(chain, kNoBudget);
 }
 
 float expr::eval(const char *str) {
@@ -499,3 +565,87 @@ float expr::eval(const char *str) {
     auto chain = tokens2chain(tokens, nullptr);
     return eval(chain);
 }
+
+const char *expr::message(const Errc code) {
+    switch (code) {
+    case Errc::OK:
+        return "";
+    case Errc::EMPTY_STRING:
+        return "Empty string";
+    case Errc::EMPTY_EXPR:
+        return "Empty expression";
+    case Errc::UNKNOWN_OP:
+        return "Unknown operator";
+    case Errc::UNKNOWN_FN:
+        return "Unknown function";
+    case Errc::UNMATCHED_RPAR:
+        return "Unmatched right parenthesis";
+    case Errc::UNMATCHED_LPAR:
+        return "Unmatched left parenthesis";
+    case Errc::UNFINISHED_EXPR:
+        return "Unfinished expression";
+    case Errc::INCOMPLETE_EXPR:
+        return "Incomplete expression";
+    case Errc::DANGLING_NUM_OPL:
+        return "Dangling NUM / OPL";
+    case Errc::DANGLING_OPR_OPI:
+        return "Dangling OPR / OPI";
+    case Errc::RESERVED_NAME:
+        return "Reserved name";
+    case Errc::IO_ERROR:
+        return "Cannot read input";
+    case Errc::TOO_LONG:
+        return "Input too long";
+    case Errc::TOO_MANY_TOKENS:
+        return "Too many tokens";
+    case Errc::TOO_DEEP:
+        return "Nesting too deep";
+    case Errc::TOO_MANY_STEPS:
+        return "Too many steps";
+    case Errc::CANCELLED:
+        return "Cancelled";
+    case Errc::TIMED_OUT:
+        return "Deadline exceeded";
+    case Errc::BAD_CALL:
+        return "Misplaced call or comma";
+    }
+    return "Unknown error";
+}
+
+expr::Error expr::Budget::Poll(const uint64_t offset) const {
+    if (cancel != nullptr && cancel->load(std::memory_order_relaxed))
+        return {Errc::CANCELLED, offset, "Cancelled"};
+    if (deadline != Clock::time_point::max() && Clock::now() >= deadline)
+        return {Errc::TIMED_OUT, offset, "Deadline exceeded"};
+    return {};
+}
+
+float expr::eval(const std::shared_ptr<Chain> &chain, const Budget &budget) {
+    // nothing but parentheses, e.g. `()`, makes no chain at all
+    if (chain == nullptr)
+        throw std::runtime_error("Empty expression");
+    auto c = chain;
+    uint64_t visited = 0;
+    for (uint64_t steps = 0;; ++steps) {
+        if (c->rhs == nullptr && sign2optype(c->op) == SignType::NONE) {
+            break;
+        }
+        if (steps == budget.max_steps)
+            throw std::runtime_error("Too many steps");
+        c = reduce_polled(c, budget, visited);
+    }
+    return c->lhs;
+}
+
+float expr::eval(const char *str, const Budget &budget) {
+    std::vector<Token> tokens;
+    std::vector<uint32_t> offsets;
+    const Error err = lex(str, tokens, offsets, nullptr, &budget);
+    if (err.code != Errc::OK)
+        throw std::runtime_error(err.msg);
+    // the chain is built recursively, one level per token
+    if (tokens.size() > kMaxChainTokens)
+        throw std::runtime_error(message(Errc::TOO_MANY_TOKENS));
+    auto chain = tokens2chain(tokens, nullptr);
+    return eval(chain, budget);
+}
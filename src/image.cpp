@@ -0,0 +1,171 @@
+// Write and map binary images of compiled expressions
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "image.hpp"
+#include "sign.hpp"
+
+namespace {
+
+    static constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ULL;
+    static constexpr uint64_t kFnvPrime = 0x100000001b3ULL;
+    static constexpr size_t kAlign = 8;
+
+    size_t align_up(const size_t n) { return (n + kAlign - 1) & ~(kAlign - 1); }
+
+    // true if `n` items of `size` bytes at `off` lie inside a file of `len`
+    bool in_bounds(const uint64_t off, const uint64_t n, const size_t size,
+                   const size_t len) {
+        return off % kAlign == 0 && off <= len && n <= (len - off) / size;
+    }
+
+} // namespace
+
+uint64_t image::checksum(const void *data, size_t len) {
+    const auto *p = static_cast<const unsigned char *>(data);
+    uint64_t h = kFnvOffset;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= kFnvPrime;
+    }
+    return h;
+}
+
+void image::write(const std::string &path,
+                  const std::vector<std::string> &srcs) {
+    std::vector<Entry> entries;
+    std::vector<prog::Instr> code;
+    std::vector<float> pool;
+    std::string str;
+    // deduplicate constants across programs by bit pattern
+    std::unordered_map<uint32_t, uint32_t> map_pool;
+
+    for (const auto &src : srcs) {
+        const auto p = prog::compile(src.c_str());
+        entries.push_back({static_cast<uint32_t>(code.size()),
+                           static_cast<uint32_t>(p.code.size()), p.depth,
+                           static_cast<uint32_t>(str.size()),
+                           static_cast<uint32_t>(src.size())});
+        for (auto in : p.code) {
+            if (in.op == static_cast<uint8_t>(expr::Sign::NONE)) {
+                const float v = p.pool[in.arg];
+                auto [it, _] = map_pool.try_emplace(
+                    std::bit_cast<uint32_t>(v),
+                    static_cast<uint32_t>(pool.size()));
+                if (it->second == pool.size())
+                    pool.push_back(v);
+                in.arg = it->second;
+            }
+            code.push_back(in);
+        }
+        str += src;
+    }
+
+    Header hdr{};
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version = kVersion;
+    hdr.endian = kEndian;
+    hdr.n_expr = static_cast<uint32_t>(entries.size());
+    hdr.n_code = static_cast<uint32_t>(code.size());
+    hdr.n_pool = static_cast<uint32_t>(pool.size());
+    hdr.n_str = static_cast<uint32_t>(str.size());
+    hdr.off_expr = sizeof(Header);
+    hdr.off_code = align_up(hdr.off_expr + entries.size() * sizeof(Entry));
+    hdr.off_pool = align_up(hdr.off_code + code.size() * sizeof(prog::Instr));
+    hdr.off_str = align_up(hdr.off_pool + pool.size() * sizeof(float));
+
+    // payload: everything after the header, zero padded between sections
+    std::vector<char> buf(hdr.off_str + str.size() - sizeof(Header), 0);
+    auto put = [&](const uint64_t off, const void *src, const size_t n) {
+        if (n > 0)
+            std::memcpy(buf.data() + off - sizeof(Header), src, n);
+    };
+    put(hdr.off_expr, entries.data(), entries.size() * sizeof(Entry));
+    put(hdr.off_code, code.data(), code.size() * sizeof(prog::Instr));
+    put(hdr.off_pool, pool.data(), pool.size() * sizeof(float));
+    put(hdr.off_str, str.data(), str.size());
+    hdr.checksum = checksum(buf.data(), buf.size());
+
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs)
+        throw std::runtime_error("Cannot open image for writing: " + path);
+    ofs.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    ofs.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    if (!ofs)
+        throw std::runtime_error("Failed to write image: " + path);
+}
+
+void image::pack(const std::string &path_in, const std::string &path_out) {
+    std::ifstream ifs(path_in);
+    if (!ifs)
+        throw std::runtime_error("Cannot open formula file: " + path_in);
+
+    std::vector<std::string> srcs;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        srcs.push_back(line);
+    }
+    write(path_out, srcs);
+}
+
+image::Image::Image(const std::string &path, bool verify) : file_(path) {
+    const char *p = file_.Data();
+    const size_t len = file_.Size();
+    if (len < sizeof(Header))
+        throw std::runtime_error("Truncated image: " + path);
+
+    hdr_ = reinterpret_cast<const Header *>(p);
+    const char *err = nullptr;
+    if (std::memcmp(hdr_->magic, kMagic, sizeof(kMagic)) != 0)
+        err = "Not an expression image";
+    else if (hdr_->endian != kEndian)
+        err = "Image byte order mismatch";
+    else if (hdr_->version != kVersion)
+        err = "Unsupported image version";
+    else if (!in_bounds(hdr_->off_expr, hdr_->n_expr, sizeof(Entry), len) ||
+             !in_bounds(hdr_->off_code, hdr_->n_code, sizeof(prog::Instr),
+                        len) ||
+             !in_bounds(hdr_->off_pool, hdr_->n_pool, sizeof(float), len) ||
+             !in_bounds(hdr_->off_str, hdr_->n_str, 1, len))
+        err = "Corrupted image sections";
+    else if (verify && checksum(p + sizeof(Header), len - sizeof(Header)) !=
+                           hdr_->checksum)
+        err = "Image checksum mismatch";
+
+    if (err == nullptr) {
+        entries_ = reinterpret_cast<const Entry *>(p + hdr_->off_expr);
+        code_ = reinterpret_cast<const prog::Instr *>(p + hdr_->off_code);
+        pool_ = reinterpret_cast<const float *>(p + hdr_->off_pool);
+        str_ = p + hdr_->off_str;
+        for (uint32_t i = 0; i < hdr_->n_expr; ++i) {
+            const Entry &e = entries_[i];
+            if (e.code > hdr_->n_code || e.size > hdr_->n_code - e.code ||
+                e.name > hdr_->n_str || e.len > hdr_->n_str - e.name) {
+                err = "Corrupted image entry";
+                break;
+            }
+            // `prog::run` trusts the ops, pool indices and depth
+            if (!prog::valid(Prog(i), hdr_->n_pool)) {
+                err = "Corrupted image program";
+                break;
+            }
+        }
+    }
+    if (err != nullptr)
+        throw std::runtime_error(std::string(err) + ": " + path);
+}
+
+prog::View image::Image::Prog(uint32_t i) const {
+    const Entry &e = entries_[i];
+    return {code_ + e.code, e.size, pool_, e.depth};
+}
+
+std::string_view image::Image::Source(uint32_t i) const {
+    const Entry &e = entries_[i];
+    return {str_ + e.name, e.len};
+}
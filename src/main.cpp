@@ -4,11 +4,18 @@
 #include <functional>
 #include <iostream>
 #include <optional>
+#include <random>
+#include <sstream>
 
+#include "cache.hpp"
+#include "exact.hpp"
 #include "exam.hpp"
 #include "expr.hpp"
-
-static constexpr float EPSILON = 1e-3f;
+#include "image.hpp"
+#include "memo.hpp"
+#include "script.hpp"
+#include "shm.hpp"
+#include "stream.hpp"
 
 std::atomic<bool> flag_int(false);
 
@@ -61,8 +68,153 @@ float get_num(const std::string &prompt,
     }
 }
 
-int main() {
+void usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [command]\n"
+              << "  (no command)        interactive calculator\n"
+              << "  pack <in> <out>     compile formulas into an image\n"
+              << "  load <image> [exact|ulp1|ulp4|memo]\n"
+              << "                      evaluate every formula in an image\n"
+              << "  batch <file> [cache]\n"
+              << "                      evaluate every line of a file, "
+                 "through a result cache\n"
+              << "  run <script>        run assignments and expressions, one "
+                 "per line\n"
+              << "  stream <file>       evaluate one expression of any size, "
+                 "`-` for stdin\n"
+              << "  serve-shm <name> [spin|futex]\n"
+              << "                      evaluate requests of "
+                 "`scicalc_shm_client`\n"
+              << "  exam-gen <sheet> <ops> <exams> <quizzes> <operands> <min> "
+                 "<max> [seed]\n"
+              << "                      generate exams and answer keys\n"
+              << "  exam-print <sheet>  print the quizzes of a sheet\n"
+              << "  exam-grade <sheet> <answers> <scores>\n"
+              << "                      grade `<student> <exam> <answer>...` "
+                 "lines\n";
+}
+
+void report(const char *what, const exam::Stats &st) {
+    std::cerr << what << " " << st.n_quiz << " quizzes in " << st.secs
+              << " s (" << static_cast<size_t>(st.n_quiz / st.secs)
+              << " quizzes/s)" << std::endl;
+}
+
+vmath::Accuracy parse_accuracy(const std::string &s) {
+    if (s == "exact")
+        return vmath::Accuracy::EXACT;
+    if (s == "ulp1")
+        return vmath::Accuracy::ULP1;
+    if (s == "ulp4")
+        return vmath::Accuracy::ULP4;
+    throw std::runtime_error("Unknown accuracy: " + s);
+}
+
+// Non-interactive subcommands
+int run_cmd(int argc, char **argv) {
+    const std::string cmd = argv[1];
+    try {
+        if (cmd == "pack" && argc == 4) {
+            image::pack(argv[2], argv[3]);
+            return 0;
+        }
+        if (cmd == "load" && (argc == 3 || argc == 4)) {
+            const image::Image img(argv[2]);
+            std::vector<prog::View> views;
+            for (uint32_t i = 0; i < img.Size(); ++i)
+                views.push_back(img.Prog(i));
+            std::vector<float> res(views.size());
+            if (argc == 4 && std::string(argv[3]) == "memo") {
+                memo::Table t;
+                memo::run_batch(views, res.data(), t);
+                const memo::Stats &st = t.Usage();
+                std::cerr << "memo: " << st.hits << " hits of " << st.lookups
+                          << " lookups (" << st.HitRate() * 100 << "%), "
+                          << st.evictions << " evictions" << std::endl;
+            } else {
+                prog::run_batch(views, res.data(),
+                                argc == 4 ? parse_accuracy(argv[3])
+                                          : vmath::Accuracy::EXACT);
+            }
+            for (uint32_t i = 0; i < img.Size(); ++i)
+                std::cout << img.Source(i) << " = " << res[i] << "\n";
+            return 0;
+        }
+        if (cmd == "batch" && (argc == 3 || argc == 4)) {
+            if (argc == 3) {
+                cache::run(argv[2], nullptr, std::cout);
+                return 0;
+            }
+            cache::Store store(argv[3]);
+            cache::run(argv[2], &store, std::cout);
+            const cache::Stats &st = store.Usage();
+            std::cerr << "cache: " << st.hits << " hits of " << st.lookups
+                      << " lookups (" << st.HitRate() * 100 << "%), "
+                      << store.Size() << " entries, " << store.Bytes()
+                      << " bytes" << std::endl;
+            return 0;
+        }
+        if (cmd == "run" && argc == 3) {
+            env::Env vars;
+            script::run(std::string(argv[2]), vars, std::cout);
+            return 0;
+        }
+        if (cmd == "stream" && argc == 3) {
+            std::cout << stream::eval(argv[2]) << std::endl;
+            return 0;
+        }
+        if (cmd == "serve-shm" && (argc == 3 || argc == 4)) {
+            const std::string mode = argc == 4 ? argv[3] : "futex";
+            if (mode != "spin" && mode != "futex")
+                throw std::runtime_error("Unknown wait mode: " + mode);
+            shm::Channel ch = shm::Channel::Create(argv[2]);
+            const uint64_t n = ch.Serve(mode == "spin" ? shm::Wait::SPIN
+                                                      : shm::Wait::FUTEX);
+            std::cerr << "served " << n << " requests" << std::endl;
+            return 0;
+        }
+        if (cmd == "exam-gen" && (argc == 9 || argc == 10)) {
+            const exam::Generator g(argv[3], std::stoi(argv[6]),
+                                    std::stoi(argv[7]), std::stoi(argv[8]));
+            const uint64_t seed =
+                argc == 10 ? std::stoull(argv[9]) : std::random_device{}();
+            report("generated",
+                   exam::generate(argv[2], g, std::stoul(argv[4]),
+                                  std::stoul(argv[5]), seed));
+            return 0;
+        }
+        if (cmd == "exam-print" && argc == 3) {
+            exam::Sheet(argv[2]).Print(std::cout);
+            return 0;
+        }
+        if (cmd == "exam-grade" && argc == 5) {
+            report("graded", exam::grade(argv[2], argv[3], argv[4]));
+            return 0;
+        }
+    } catch (std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    usage(argv[0]);
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        return run_cmd(argc, argv);
+
     std::string input;
+    // `exact` toggles exact integer / rational evaluation
+    bool mode_exact = false;
+    // bindings from `name = expr`, kept for the whole session as exact
+    // values so that exact mode reads them unrounded
+    exact::Env vars;
+    const auto show = [&](const exact::Value &v) {
+        if (mode_exact)
+            return v.ToStr();
+        std::ostringstream oss;
+        oss << v.ToFloat();
+        return oss.str();
+    };
 
     // Register signal handler using sigaction
     struct sigaction sa;
@@ -89,6 +241,20 @@ int main() {
             continue;
         }
 
+        if (input == "vars") {
+            for (size_t i = 0; i < vars.Size(); ++i)
+                std::cout << vars.Name(i) << " = " << show(vars.At(i))
+                          << std::endl;
+            continue;
+        }
+
+        if (input == "exact") {
+            mode_exact = !mode_exact;
+            std::cout << "exact mode " << (mode_exact ? "on" : "off")
+                      << std::endl;
+            continue;
+        }
+
         else if (input == "exam") {
             std::string s_op;
 
@@ -119,22 +285,24 @@ int main() {
             std::vector<float> arr_ansexp(n);
             std::vector<std::string> arr_expr(n);
 
-            // Generate expressions and store correct answers
-            for (int i = 0; i < n; ++i) {
-                std::string s_expr =
-                    exam::rand_expr(s_op, n_opd, min_opd, max_opd);
-                arr_expr[i] = s_expr;
-                arr_ansexp[i] = expr::eval(s_expr.c_str());
-            }
-
-            // Get user answers
-            for (int i = 0; i < n;) {
-                float ans_usr = get_num(
-                    "Quiz " + std::to_string(i + 1) + ": " + arr_expr[i] +
-                        " = ",
-                    [](int) { return true; }, flag_int);
-                arr_ansusr[i] = ans_usr;
-                ++i;
+            // Quizzes are drawn and checked in the background while the
+            // earlier ones are answered
+            try {
+                exam::Session session(
+                    exam::Generator(s_op, n_opd, min_opd, max_opd), n,
+                    std::random_device{}());
+                for (int i = 0; i < n; ++i) {
+                    exam::Quiz q = session.Next();
+                    arr_expr[i] = std::move(q.expr);
+                    arr_ansexp[i] = q.ans;
+                    arr_ansusr[i] = get_num(
+                        "Quiz " + std::to_string(i + 1) + ": " + arr_expr[i] +
+                            " = ",
+                        [](int) { return true; }, flag_int);
+                }
+            } catch (std::exception &ex) {
+                std::cerr << "Error: " << ex.what() << std::endl;
+                continue;
             }
 
             // Display results after all answers are collected
@@ -146,7 +314,7 @@ int main() {
                 if (arr_ansusr[i].has_value()) {
                     const float ans_usr = arr_ansusr[i].value();
                     std::cout << ans_usr;
-                    if (std::abs(ans_usr - arr_ansexp[i]) < EPSILON) {
+                    if (std::abs(ans_usr - arr_ansexp[i]) < exam::kEpsilon) {
                         std::cout << " ✅" << std::endl;
                         ++cnt_correct;
                     } else {
@@ -171,8 +339,15 @@ int main() {
         std::string safe_input = sanitize_input(input);
         if (!safe_input.empty()) {
             try {
-                float ans = expr::eval(safe_input.c_str());
-                std::cout << ans << std::endl;
+                const auto r = script::exec(safe_input, vars, mode_exact);
+                if (!r) {
+                    std::cerr << "Error: " << r.error().msg << std::endl;
+                } else if (r.value().kind == script::Kind::ASSIGN) {
+                    std::cout << r.value().name << " = "
+                              << show(r.value().value) << std::endl;
+                } else if (r.value().kind == script::Kind::EXPR) {
+                    std::cout << show(r.value().value) << std::endl;
+                }
             } catch (std::exception &ex) {
                 std::cerr << "Error: " << ex.what() << std::endl;
             }
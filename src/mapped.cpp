@@ -0,0 +1,50 @@
+// Read-only memory mappings of whole files
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "mapped.hpp"
+
+mapped::File::File(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open file: " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat file: " + path);
+    }
+    len_ = static_cast<size_t>(st.st_size);
+    if (len_ == 0) {
+        // mmap rejects empty mappings
+        close(fd);
+        return;
+    }
+    base_ = mmap(nullptr, len_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base_ == MAP_FAILED) {
+        base_ = nullptr;
+        throw std::runtime_error("Cannot map file: " + path);
+    }
+}
+
+mapped::File::~File() {
+    if (base_ != nullptr)
+        munmap(base_, len_);
+}
+
+mapped::File::File(File &&o) noexcept
+    : base_(std::exchange(o.base_, nullptr)), len_(std::exchange(o.len_, 0)) {}
+
+mapped::File &mapped::File::operator=(File &&o) noexcept {
+    if (this != &o) {
+        if (base_ != nullptr)
+            munmap(base_, len_);
+        base_ = std::exchange(o.base_, nullptr);
+        len_ = std::exchange(o.len_, 0);
+    }
+    return *this;
+}
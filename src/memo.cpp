@@ -0,0 +1,103 @@
+// Operator memo table and a stack machine consulting it
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#include "memo.hpp"
+#include "sign.hpp"
+
+namespace {
+
+    using expr::Sign;
+
+    // programs shallower than this run on an on-stack buffer
+    static constexpr uint32_t kStackInline = 64;
+
+    bool is_infix(const uint8_t op) {
+        const auto [bpl, bpr] = expr::kMapOp2Bp[op - expr::kMinSignOp];
+        return bpl != 0 && bpr != 0;
+    }
+
+    // operators calling into libm, dearer than a lookup
+    bool is_libm(const uint8_t op) {
+        return op == static_cast<uint8_t>(Sign::FCT) ||
+               op == static_cast<uint8_t>(Sign::LOG) ||
+               op == static_cast<uint8_t>(Sign::EXP) ||
+               op == static_cast<uint8_t>(Sign::SIN) ||
+               op == static_cast<uint8_t>(Sign::COS) ||
+               op == static_cast<uint8_t>(Sign::TAN) ||
+               op == static_cast<uint8_t>(Sign::EXF);
+    }
+
+    // splitmix64 finalizer
+    uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    float run_on(const prog::View &v, memo::Table &t, float *stack) {
+        float *top = stack; // one past the top
+        for (uint32_t i = 0; i < v.size; ++i) {
+            const prog::Instr &in = v.code[i];
+            if (in.op == static_cast<uint8_t>(Sign::NONE)) {
+                *top++ = v.pool[in.arg];
+                continue;
+            }
+            const bool infix = is_infix(in.op);
+            if (infix)
+                --top;
+            const float b = infix ? *top : expr::kFDummy;
+            if (is_libm(in.op)) {
+                top[-1] = t.Apply(in.op, top[-1], b);
+            } else {
+                const auto fn = expr::kMapOp2Fn[in.op - expr::kMinSignOp];
+                top[-1] = fn(top[-1], b);
+            }
+        }
+        return stack[0];
+    }
+
+} // namespace
+
+memo::Table::Table(const size_t slots)
+    : slots_(std::bit_ceil(std::max<size_t>(slots, 1)), Slot{}) {}
+
+float memo::Table::Apply(const uint8_t op, const float a, const float b) {
+    const auto ba = std::bit_cast<uint32_t>(a);
+    const auto bb = std::bit_cast<uint32_t>(b);
+    const uint64_t h = mix((static_cast<uint64_t>(ba) << 32 | bb) ^
+                           (static_cast<uint64_t>(op) << 56));
+    Slot &s = slots_[h & (slots_.size() - 1)];
+    ++stats_.lookups;
+    if (s.op == op && s.a == ba && s.b == bb) {
+        ++stats_.hits;
+        return s.v;
+    }
+    if (s.op != static_cast<uint8_t>(Sign::NONE))
+        ++stats_.evictions;
+    const float v = expr::kMapOp2Fn[op - expr::kMinSignOp](a, b);
+    s = {ba, bb, v, op, {0}};
+    ++stats_.inserts;
+    return v;
+}
+
+void memo::Table::Clear() {
+    std::fill(slots_.begin(), slots_.end(), Slot{});
+    stats_ = {};
+}
+
+float memo::run(const prog::View &v, Table &t) {
+    if (v.depth <= kStackInline) {
+        std::array<float, kStackInline> stack;
+        return run_on(v, t, stack.data());
+    }
+    std::vector<float> stack(v.depth);
+    return run_on(v, t, stack.data());
+}
+
+void memo::run_batch(const std::vector<prog::View> &views, float *out,
+                     Table &t) {
+    for (size_t i = 0; i < views.size(); ++i)
+        out[i] = run(views[i], t);
+}
@@ -0,0 +1,399 @@
+// Split huge expressions at their outermost chain and evaluate it in parallel
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#include "par.hpp"
+#include "pool.hpp"
+#include "prog.hpp"
+#include "sign.hpp"
+
+namespace {
+
+    using expr::Sign;
+
+    // chunks per pool thread, so that uneven operands still balance
+    static constexpr size_t kChunksPerThread = 8;
+    // bytes below which the string is scanned in one piece
+    static constexpr size_t kScanGrain = size_t(1) << 16;
+    // past this depth the uint8 binding powers of `expr::lex` wrap around;
+    // such strings are left to the serial path
+    static constexpr int64_t kMaxDepth = (UINT8_MAX - 6) / expr::kBpDelta;
+
+    // start of the minima tracked by `scan`, far above any binding power
+    static constexpr int64_t kNoBp = INT64_MAX / 4;
+    // binding power of a character that is no such operator, which stays
+    // above `kNoBp` when shifted by any depth
+    static constexpr int64_t kNotOp = 2 * kNoBp;
+
+    static constexpr int64_t bp(const Sign op, const bool left) {
+        const auto [bpl, bpr] =
+            expr::kMapOp2Bp[static_cast<uint8_t>(op) - expr::kMinSignOp];
+        return left ? bpl : bpr;
+    }
+
+    // The outermost chain splits at its loosest infix operators (LBP `lo`)
+    // unless some operator would bind across them:
+    // - a right associative infix operator at `lo`, e.g. `2^3^2`
+    // - a postfix operator with LBP <= `lo`, e.g. the `!` of `(1 + 2)!`
+    // - a prefix operator with RBP < `lo`, e.g. the `-` of `-2 * 3`
+    // i.e. each of them blocks the split if `lo` >= its block value
+    static constexpr int64_t kBlockFn = [] {
+        // the loosest prefix function of `expr::kIdents`, assumed at the
+        // start of every identifier
+        int64_t block = kNotOp;
+        for (const auto &id : expr::kIdents) {
+            if (static_cast<uint8_t>(id.sign) < expr::kMinSignOp ||
+                bp(id.sign, true) != 0)
+                continue;
+            block = std::min(block, bp(id.sign, false) + 1);
+        }
+        return block;
+    }();
+    static constexpr int64_t kBlockUnary = bp(Sign::USB, false) + 1;
+
+    // What `par::split` needs to know about a character
+    struct ScanChr {
+        int8_t depth;  // +1 for `(`, -1 for `)`
+        bool bad;      // not accepted by `expr::lex`
+        bool alpha;    // part of an identifier
+        int64_t opi;   // LBP of an infix operator
+        int64_t block; // block value of the operator
+    };
+
+    // NOTE: every entry is assigned in full, GCC 12 loses default member
+    // initializers in large constexpr arrays
+    static constexpr std::array<ScanChr, 256> kMapChr2Scan = [] {
+        std::array<ScanChr, 256> t{};
+        for (auto &e : t)
+            e = {0, true, false, kNotOp, kNotOp};
+        for (const char c : {' ', '\t', '\n', '\v', '\f', '\r', '.'})
+            t[static_cast<uint8_t>(c)].bad = false;
+        for (int c = '0'; c <= '9'; ++c)
+            t[c].bad = false;
+        for (int c = 'a'; c <= 'z'; ++c) {
+            t[c].bad = t[c - 'a' + 'A'].bad = false;
+            t[c].alpha = t[c - 'a' + 'A'].alpha = true;
+        }
+        for (int c = 1; c < 256; ++c) {
+            const uint8_t sign = expr::chr2sign(static_cast<char>(c));
+            if (sign == static_cast<uint8_t>(Sign::NONE))
+                continue;
+            t[c].bad = false;
+            if (sign == static_cast<uint8_t>(Sign::PAL)) {
+                t[c].depth = 1;
+                continue;
+            }
+            if (sign == static_cast<uint8_t>(Sign::PAR)) {
+                t[c].depth = -1;
+                continue;
+            }
+            // `,` is only accepted within parentheses
+            if (sign == static_cast<uint8_t>(Sign::CMA))
+                continue;
+            const auto [bpl, bpr] = expr::kMapOp2Bp[sign - expr::kMinSignOp];
+            if (bpr == 0) { // OPL
+                t[c].block = bpl;
+            } else { // OPI, the first `+ -` is handled separately
+                t[c].opi = bpl;
+                if (bpl != bpr)
+                    t[c].block = bpl;
+            }
+        }
+        return t;
+    }();
+
+    const ScanChr &scan_chr(const char c) {
+        return kMapChr2Scan[static_cast<uint8_t>(c)];
+    }
+
+    // Binding powers seen in one chunk of the string, relative to the
+    // parenthesis depth at its start
+    struct Scan {
+        int64_t depth = 0;     // depth at the end
+        int64_t depth_min = 0; // lowest depth reached
+        int64_t depth_max = 0; // highest depth reached
+        bool bad = false;      // a character `expr::lex` rejects
+        int64_t lo = kNoBp;    // loosest infix operator
+        int64_t block = kNoBp; // lowest block value
+        std::vector<uint32_t> cuts; // infix operators at the overall `lo`
+    };
+
+    // Scan [begin, end) of `str` for binding powers the way `expr::lex`
+    // assigns them. Characters come in no particular order, so nothing here
+    // branches on them
+    void scan(const char *str, const size_t begin, const size_t end,
+              Scan &s) {
+        // locals, since stores through `s` could alias the characters
+        int64_t depth = 0;
+        int64_t depth_min = 0;
+        int64_t depth_max = 0;
+        bool bad = false;
+        int64_t lo = kNoBp;
+        int64_t block = kNoBp;
+        bool prev_alpha = begin > 0 && scan_chr(str[begin - 1]).alpha;
+        for (size_t i = begin; i < end; ++i) {
+            const ScanChr &e = scan_chr(str[i]);
+            depth += e.depth;
+            depth_min = std::min(depth_min, depth);
+            depth_max = std::max(depth_max, depth);
+            bad |= e.bad;
+            const int64_t shift = depth * expr::kBpDelta;
+            const bool fn = e.alpha && !prev_alpha;
+            prev_alpha = e.alpha;
+            block = std::min(block, (fn ? kBlockFn : e.block) + shift);
+            lo = std::min(lo, e.opi + shift);
+        }
+        s.depth = depth;
+        s.depth_min = depth_min;
+        s.depth_max = depth_max;
+        s.bad = bad;
+        s.lo = lo;
+        s.block = block;
+    }
+
+    // Offsets of the infix operators with LBP `lo` in [begin, end), `lo`
+    // being relative to the depth at `begin`
+    void collect(const char *str, const size_t begin, const size_t end,
+                 const int64_t lo, std::vector<uint32_t> &cuts) {
+        int64_t depth = 0;
+        for (size_t i = begin; i < end; ++i) {
+            const ScanChr &e = scan_chr(str[i]);
+            depth += e.depth;
+            if (e.opi + depth * expr::kBpDelta == lo)
+                cuts.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    // Scan the string in chunks on `p`, if any, shift each chunk by the depth
+    // it starts at, then collect the loosest operators overall
+    std::vector<uint32_t> split_chunks(const char *str, const size_t len,
+                                       pool::Pool *p) {
+        size_t first = 0;
+        while (first < len && isspace(str[first]))
+            ++first;
+        int64_t block = kNoBp;
+        // only the first sign is unary, `+` and `-` alike
+        if (first < len && (str[first] == '+' || str[first] == '-')) {
+            block = kBlockUnary;
+            ++first;
+        }
+
+        // chunk boundaries, moved off identifiers
+        const size_t n_chunk = p != nullptr && len - first >= kScanGrain
+                                   ? size_t(p->Size()) * kChunksPerThread
+                                   : 1;
+        std::vector<size_t> bounds(n_chunk + 1, len);
+        bounds[0] = first;
+        for (size_t k = 1; k < n_chunk; ++k) {
+            size_t b = std::max(bounds[k - 1],
+                                first + (len - first) / n_chunk * k);
+            while (b < len && scan_chr(str[b - 1]).alpha &&
+                   scan_chr(str[b]).alpha)
+                ++b;
+            bounds[k] = b;
+        }
+        auto for_chunks = [&](const std::function<void(size_t)> &fn) {
+            const auto range = [&](size_t begin, size_t end) {
+                for (size_t k = begin; k < end; ++k)
+                    fn(k);
+            };
+            if (p != nullptr)
+                p->For(n_chunk, 1, range);
+            else
+                range(0, n_chunk);
+        };
+
+        std::vector<Scan> scans(n_chunk);
+        for_chunks([&](size_t k) {
+            scan(str, bounds[k], bounds[k + 1], scans[k]);
+        });
+
+        std::vector<int64_t> shift(n_chunk);
+        int64_t depth = 0;
+        int64_t lo = kNoBp;
+        for (size_t k = 0; k < n_chunk; ++k) {
+            const Scan &s = scans[k];
+            if (s.bad || depth + s.depth_min < 0 ||
+                depth + s.depth_max > kMaxDepth)
+                return {};
+            shift[k] = depth * expr::kBpDelta;
+            lo = std::min(lo, s.lo + shift[k]);
+            block = std::min(block, s.block + shift[k]);
+            depth += s.depth;
+        }
+        if (depth != 0 || lo >= expr::kBpDelta || block <= lo)
+            return {};
+
+        for_chunks([&](size_t k) {
+            if (scans[k].lo + shift[k] == lo)
+                collect(str, bounds[k], bounds[k + 1], lo - shift[k],
+                        scans[k].cuts);
+        });
+        std::vector<uint32_t> cuts;
+        for (const auto &s : scans)
+            cuts.insert(cuts.end(), s.cuts.begin(), s.cuts.end());
+        return cuts;
+    }
+
+    // The outermost chain of a string: operand `i` lies between cut `i - 1`
+    // and cut `i`
+    struct Chain {
+        const char *str;
+        size_t len;
+        const std::vector<uint32_t> &cuts;
+        const env::Env *env;
+
+        size_t Size() const { return cuts.size() + 1; }
+
+        // operator between operand `i` and `i + 1`
+        uint8_t Op(const size_t i) const {
+            return expr::chr2sign(str[cuts[i]]);
+        }
+
+        // Lex and evaluate operand `i`, false on any error
+        bool Operand(const size_t i, float &out) const {
+            // `prog::try_eval` needs a C string
+            thread_local std::string buf;
+            const size_t begin = i == 0 ? 0 : cuts[i - 1] + 1;
+            const size_t end = i == cuts.size() ? len : cuts[i];
+            buf.assign(str + begin, end - begin);
+            // a leading sign is unary on its own but infix in the chain
+            const size_t k = buf.find_first_not_of(" \t\n\v\f\r");
+            if (i > 0 && k != std::string::npos &&
+                (buf[k] == '+' || buf[k] == '-'))
+                return false;
+            const auto v = prog::try_eval(buf.c_str(), env);
+            if (!v)
+                return false;
+            out = v.value();
+            return true;
+        }
+    };
+
+    // Same as `expr::kMapOp2Fn`, without the indirect call for the chain
+    // operators
+    float combine(const uint8_t op, const float a, const float b) {
+        switch (static_cast<Sign>(op)) {
+        case Sign::ADD:
+            return a + b;
+        case Sign::SUB:
+            return a - b;
+        case Sign::MUL:
+            return a * b;
+        case Sign::DIV:
+            return a / b;
+        default:
+            return expr::kMapOp2Fn[op - expr::kMinSignOp](a, b);
+        }
+    }
+
+    // Evaluate the operands in parallel and fold them left to right, as the
+    // serial evaluation does
+    bool fold(const Chain &c, pool::Pool &p, const size_t grain, float &out) {
+        std::vector<float> vals(c.Size());
+        std::atomic<bool> ok{true};
+        p.For(vals.size(), grain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (!c.Operand(i, vals[i])) {
+                    ok.store(false, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        });
+        if (!ok.load())
+            return false;
+        float acc = vals[0];
+        for (size_t i = 0; i + 1 < vals.size(); ++i)
+            acc = combine(c.Op(i), acc, vals[i + 1]);
+        out = acc;
+        return true;
+    }
+
+    // Sum (`+ -` chain) or product (`*` chain) of the operands, one partial
+    // result per chunk
+    bool reduce(const Chain &c, pool::Pool &p, const size_t grain,
+                const bool sum, float &out) {
+        const size_t n = c.Size();
+        const float unit = sum ? 0.0f : 1.0f;
+        // `For` may run fewer, larger chunks than asked for
+        std::vector<float> partial((n + grain - 1) / grain, unit);
+        std::atomic<bool> ok{true};
+        p.For(n, grain, [&](size_t begin, size_t end) {
+            float acc = unit;
+            for (size_t i = begin; i < end; ++i) {
+                float v = 0;
+                if (!c.Operand(i, v)) {
+                    ok.store(false, std::memory_order_relaxed);
+                    return;
+                }
+                if (!sum)
+                    acc *= v;
+                else if (i > 0 &&
+                         c.Op(i - 1) == static_cast<uint8_t>(Sign::SUB))
+                    acc -= v;
+                else
+                    acc += v;
+            }
+            partial[begin / grain] = acc;
+        });
+        if (!ok.load())
+            return false;
+        float acc = partial[0];
+        for (size_t i = 1; i < partial.size(); ++i)
+            acc = sum ? acc + partial[i] : acc * partial[i];
+        out = acc;
+        return true;
+    }
+
+} // namespace
+
+std::vector<uint32_t> par::split(const char *str) {
+    return split_chunks(str, std::strlen(str), nullptr);
+}
+
+expr::Expected<float> par::try_eval(const char *str, const Options &opt,
+                                    const env::Env *env) {
+    const size_t len = std::strlen(str);
+    if (len < opt.threshold)
+        return prog::try_eval(str, env);
+    pool::Pool &p = opt.pool != nullptr ? *opt.pool : pool::shared();
+    // the prescan only pays off when the operands are spread over threads
+    if (p.Size() < 2)
+        return prog::try_eval(str, env);
+    const auto cuts = split_chunks(str, len, &p);
+    if (cuts.empty())
+        return prog::try_eval(str, env);
+
+    const Chain c{str, len, cuts, env};
+    const size_t grain =
+        std::max<size_t>(1, c.Size() / (size_t(p.Size()) * kChunksPerThread));
+    bool sum = opt.reassociate;
+    bool product = opt.reassociate;
+    for (size_t i = 0; i < cuts.size() && (sum || product); ++i) {
+        const auto op = static_cast<Sign>(c.Op(i));
+        sum = sum && (op == Sign::ADD || op == Sign::SUB);
+        product = product && op == Sign::MUL;
+    }
+
+    float v = 0;
+    const bool ok = (sum || product) ? reduce(c, p, grain, sum, v)
+                                     : fold(c, p, grain, v);
+    // let the serial path report the error, with its offset
+    if (!ok)
+        return prog::try_eval(str, env);
+    return v;
+}
+
+float par::eval(const char *str, const Options &opt) {
+    const auto v = try_eval(str, opt);
+    if (!v)
+        throw std::runtime_error(v.error().msg);
+    return v.value();
+}
@@ -0,0 +1,84 @@
+// Fixed-size thread pool
+#include <algorithm>
+
+#include "pool.hpp"
+
+pool::Pool::Pool(unsigned n) {
+    if (n == 0)
+        n = std::max(1u, std::thread::hardware_concurrency());
+    workers_.reserve(n - 1);
+    for (unsigned i = 1; i < n; ++i)
+        workers_.emplace_back([this] { Work(); });
+}
+
+pool::Pool::~Pool() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        stop_ = true;
+    }
+    cv_job_.notify_all();
+    for (auto &t : workers_)
+        t.join();
+}
+
+void pool::Pool::For(size_t n, size_t grain,
+                     const std::function<void(size_t, size_t)> &fn) {
+    if (n == 0)
+        return;
+    grain = std::max<size_t>(grain, 1);
+    if (workers_.empty() || n <= grain) {
+        fn(0, n);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk_for(mtx_for_);
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        fn_ = &fn;
+        n_ = n;
+        grain_ = grain;
+        next_.store(0, std::memory_order_relaxed);
+        n_busy_ = static_cast<unsigned>(workers_.size());
+        ++gen_;
+    }
+    cv_job_.notify_all();
+    Drain();
+
+    std::unique_lock<std::mutex> lk(mtx_);
+    cv_done_.wait(lk, [this] { return n_busy_ == 0; });
+    fn_ = nullptr;
+}
+
+// Take chunks of the current job until none is left
+void pool::Pool::Drain() {
+    while (true) {
+        const size_t begin = next_.fetch_add(grain_, std::memory_order_relaxed);
+        if (begin >= n_)
+            break;
+        (*fn_)(begin, std::min(begin + grain_, n_));
+    }
+}
+
+void pool::Pool::Work() {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lk(mtx_);
+            cv_job_.wait(lk, [&] { return stop_ || gen_ != seen; });
+            if (stop_)
+                return;
+            seen = gen_;
+        }
+        Drain();
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (--n_busy_ == 0)
+                cv_done_.notify_one();
+        }
+    }
+}
+
+pool::Pool &pool::shared() {
+    static Pool p;
+    return p;
+}
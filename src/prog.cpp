@@ -0,0 +1,473 @@
+// Compile tokens into postfix programs and run them on a stack machine
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "prog.hpp"
+#include "sign.hpp"
+
+namespace {
+
+    using expr::Sign;
+    using expr::SignType;
+
+    // programs shallower than this run on an on-stack buffer
+    static constexpr uint32_t kStackInline = 64;
+    // programs evaluated together by `run_batch`, sized so that the slots of
+    // one block stay in cache
+    static constexpr size_t kBatchBlock = 1024;
+
+    enum class CheckState : uint8_t {
+        NUL = 0, // nothing scanned yet
+        NOMOD,   // operand complete, expect OPR / OPI
+        MOD,     // operand pending, expect num / OPL
+    };
+
+    bool is_infix(const uint8_t op) {
+        const auto [bpl, bpr] = expr::kMapOp2Bp[op - expr::kMinSignOp];
+        return bpl != 0 && bpr != 0;
+    }
+
+    expr::Error check_error(const expr::Errc code,
+                            const std::vector<uint32_t> *offsets,
+                            const size_t i, const char *msg) {
+        const uint32_t off =
+            (offsets != nullptr && i < offsets->size()) ? (*offsets)[i] : 0;
+        return {code, off, msg};
+    }
+
+    // Shunting-yard over binding powers: an operator on the stack is emitted
+    // as soon as its RBP is no less than the LBP of the incoming operator,
+    // which is the same rule `expr::reduce` uses to fire the leftmost chain
+    // node. The tokens must have passed `prog::verify`. A sink with a
+    // `Stopped()` method can end the scan early
+    template <typename Sink>
+    void shunt(const std::vector<expr::Token> &tokens,
+               std::vector<expr::Token::Op> &ops, Sink &sink) {
+        ops.clear();
+        auto flush = [&](const uint8_t lbp) {
+            while (!ops.empty() && ops.back().rbp >= lbp) {
+                sink.Op(ops.back().v);
+                ops.pop_back();
+            }
+        };
+
+        for (const auto &tkn : tokens) {
+            if constexpr (requires { sink.Stopped(); }) {
+                if (sink.Stopped())
+                    return;
+            }
+            if (!tkn.isop) {
+                sink.Num(tkn.num);
+                continue;
+            }
+            switch (expr::sign2optype(tkn.op.v)) {
+            case SignType::OPR:
+                ops.push_back(tkn.op);
+                break;
+            case SignType::OPL:
+                flush(tkn.op.lbp);
+                sink.Op(tkn.op.v);
+                break;
+            default: // OPI
+                flush(tkn.op.lbp);
+                ops.push_back(tkn.op);
+                break;
+            }
+        }
+        flush(0);
+    }
+
+    // Sink emitting postfix instructions
+    struct Emitter {
+        prog::Program &p;
+        uint32_t cur = 0;
+
+        void Num(const float v) {
+            p.code.push_back({static_cast<uint8_t>(Sign::NONE), {0},
+                              static_cast<uint32_t>(p.pool.size())});
+            p.pool.push_back(v);
+            if (++cur > p.depth)
+                p.depth = cur;
+        }
+
+        void Op(const uint8_t v) {
+            p.code.push_back({v, {0}, 0});
+            if (is_infix(v))
+                --cur;
+        }
+    };
+
+    // Sink evaluating in place, for one-shot evaluation without a program.
+    // Stops at the first operator over the budget
+    struct Evaluator {
+        std::vector<float> &stack;
+        const expr::Budget *budget = nullptr;
+        uint64_t steps = 0;
+        expr::Error err;
+
+        bool Stopped() const { return err.code != expr::Errc::OK; }
+
+        void Num(const float v) { stack.push_back(v); }
+
+        void Op(const uint8_t v) {
+            if (budget != nullptr && Over())
+                return;
+            const auto fn = expr::kMapOp2Fn[v - expr::kMinSignOp];
+            if (is_infix(v)) {
+                const float b = stack.back();
+                stack.pop_back();
+                stack.back() = fn(stack.back(), b);
+            } else {
+                stack.back() = fn(stack.back(), expr::kFDummy);
+            }
+        }
+
+        bool Over() {
+            if (Stopped())
+                return true;
+            if (steps++ == budget->max_steps)
+                err = {expr::Errc::TOO_MANY_STEPS, 0, "Too many steps"};
+            else if (steps % expr::kBudgetPoll == 0)
+                err = budget->Poll(0);
+            return Stopped();
+        }
+    };
+
+    prog::Program emit(const std::vector<expr::Token> &tokens) {
+        prog::Program p;
+        p.code.reserve(tokens.size());
+        p.pool.reserve(tokens.size());
+        std::vector<expr::Token::Op> ops;
+        Emitter sink{p};
+        shunt(tokens, ops, sink);
+        return p;
+    }
+
+    // Per-thread buffers reused across `try_eval` calls
+    struct Scratch {
+        std::vector<expr::Token> tokens;
+        std::vector<uint32_t> offsets;
+        std::vector<expr::Token::Op> ops;
+        std::vector<float> stack;
+    };
+
+    Scratch &scratch() {
+        thread_local Scratch s;
+        return s;
+    }
+
+    // out[i] = op(a[i], b[i]) for a whole batch of one operator. `a` is
+    // clobbered by FCT, `b` is only read for infix operators
+    void apply(const uint8_t op, float *a, const float *b, float *out,
+               const size_t n, const vmath::Accuracy acc) {
+        switch (static_cast<Sign>(op)) {
+        case Sign::FCT:
+            for (size_t i = 0; i < n; ++i)
+                a[i] = a[i] + 1;
+            vmath::tgamma(a, out, n, acc);
+            break;
+        case Sign::LOG:
+            vmath::log(a, out, n, acc);
+            for (size_t i = 0; i < n; ++i)
+                out[i] = a[i] > 0 ? out[i] : expr::kFNan;
+            break;
+        case Sign::EXP:
+            vmath::pow(a, b, out, n, acc);
+            break;
+        case Sign::ADD:
+            for (size_t i = 0; i < n; ++i)
+                out[i] = a[i] + b[i];
+            break;
+        case Sign::SUB:
+            for (size_t i = 0; i < n; ++i)
+                out[i] = a[i] - b[i];
+            break;
+        case Sign::MUL:
+            for (size_t i = 0; i < n; ++i)
+                out[i] = a[i] * b[i];
+            break;
+        case Sign::DIV:
+            for (size_t i = 0; i < n; ++i)
+                out[i] = a[i] / b[i];
+            break;
+        default: {
+            const auto fn = expr::kMapOp2Fn[op - expr::kMinSignOp];
+            for (size_t i = 0; i < n; ++i)
+                out[i] = fn(a[i], b[i]);
+            break;
+        }
+        }
+    }
+
+    // Per-thread buffers reused across `run_batch` calls, one slot per
+    // instruction of the block: its value, operand slots and level
+    struct Batch {
+        std::vector<float> val;
+        std::vector<uint32_t> lhs, rhs, level, roots, stack;
+        std::vector<uint32_t> slots, key; // operator slots and their bucket
+        std::vector<uint32_t> start, cursor, order;
+        std::vector<float> xa, xb, res;
+    };
+
+    Batch &batch() {
+        thread_local Batch b;
+        return b;
+    }
+
+    void run_block(const prog::View *views, const size_t n_view, float *out,
+                   const vmath::Accuracy acc, Batch &b) {
+        size_t total = 0;
+        for (size_t p = 0; p < n_view; ++p)
+            total += views[p].size;
+        b.val.resize(total);
+        b.lhs.resize(total);
+        b.rhs.resize(total);
+        b.level.resize(total);
+        b.roots.resize(n_view);
+        b.slots.clear();
+        b.key.clear();
+        uint32_t n_level = 0;
+
+        // constants sit at level 0, an operator one above its highest operand
+        uint32_t slot = 0;
+        for (size_t p = 0; p < n_view; ++p) {
+            const prog::View &v = views[p];
+            b.stack.clear();
+            for (uint32_t i = 0; i < v.size; ++i, ++slot) {
+                const prog::Instr &in = v.code[i];
+                if (in.op == static_cast<uint8_t>(Sign::NONE)) {
+                    b.val[slot] = v.pool[in.arg];
+                    b.level[slot] = 0;
+                } else {
+                    uint32_t lvl = 0;
+                    if (is_infix(in.op)) {
+                        b.rhs[slot] = b.stack.back();
+                        b.stack.pop_back();
+                        lvl = b.level[b.rhs[slot]];
+                    }
+                    b.lhs[slot] = b.stack.back();
+                    b.stack.pop_back();
+                    lvl = 1 + std::max(lvl, b.level[b.lhs[slot]]);
+                    b.level[slot] = lvl;
+                    n_level = std::max(n_level, lvl);
+                    b.slots.push_back(slot);
+                    b.key.push_back((lvl - 1) * expr::kOpSize +
+                                    (in.op - expr::kMinSignOp));
+                }
+                b.stack.push_back(slot);
+            }
+            b.roots[p] = b.stack.back();
+        }
+
+        // counting sort of the operator slots by (level, operator)
+        const size_t n_bucket = static_cast<size_t>(n_level) * expr::kOpSize;
+        b.start.assign(n_bucket + 1, 0);
+        for (const uint32_t k : b.key)
+            ++b.start[k];
+        uint32_t sum = 0;
+        for (auto &c : b.start) {
+            const uint32_t n = c;
+            c = sum;
+            sum += n;
+        }
+        b.order.resize(b.key.size());
+        b.cursor.assign(b.start.begin(), b.start.end());
+        for (size_t i = 0; i < b.key.size(); ++i)
+            b.order[b.cursor[b.key[i]]++] = b.slots[i];
+
+        // gather operands, run one kernel per bucket, scatter the results
+        for (size_t k = 0; k < n_bucket; ++k) {
+            const uint32_t begin = b.start[k];
+            const size_t n = b.start[k + 1] - begin;
+            if (n == 0)
+                continue;
+            const auto op =
+                static_cast<uint8_t>(expr::kMinSignOp + k % expr::kOpSize);
+            const bool infix = is_infix(op);
+            if (b.xa.size() < n) {
+                b.xa.resize(n);
+                b.xb.resize(n);
+                b.res.resize(n);
+            }
+            for (size_t j = 0; j < n; ++j) {
+                const uint32_t s = b.order[begin + j];
+                b.xa[j] = b.val[b.lhs[s]];
+                b.xb[j] = infix ? b.val[b.rhs[s]] : expr::kFDummy;
+            }
+            apply(op, b.xa.data(), b.xb.data(), b.res.data(), n, acc);
+            for (size_t j = 0; j < n; ++j)
+                b.val[b.order[begin + j]] = b.res[j];
+        }
+
+        for (size_t p = 0; p < n_view; ++p)
+            out[p] = b.val[b.roots[p]];
+    }
+
+} // namespace
+
+// Mirrors the chaining states of `expr::tokens2chain`, scanning from the
+// rightmost token so that the same error is reported first
+expr::Error prog::verify(const std::vector<expr::Token> &tokens,
+                         const std::vector<uint32_t> *offsets) {
+    using expr::Errc;
+    CheckState s = CheckState::NUL;
+    for (size_t i = tokens.size(); i-- > 0;) {
+        const expr::Token &tkn = tokens[i];
+        const SignType t =
+            tkn.isop ? expr::sign2optype(tkn.op.v) : SignType::NONE;
+        switch (s) {
+        case CheckState::NUL:
+            if (!tkn.isop)
+                s = CheckState::NOMOD;
+            else if (t == SignType::OPL)
+                s = CheckState::MOD;
+            else
+                return check_error(Errc::UNFINISHED_EXPR, offsets, i,
+                                   "Unfinished expression");
+            break;
+        case CheckState::NOMOD:
+            if (tkn.isop && (t == SignType::OPR || t == SignType::OPI))
+                s = t == SignType::OPR ? CheckState::NOMOD : CheckState::MOD;
+            else
+                return check_error(Errc::DANGLING_NUM_OPL, offsets, i,
+                                   "Dangling NUM / OPL");
+            break;
+        case CheckState::MOD:
+            if (!tkn.isop)
+                s = CheckState::NOMOD;
+            else if (t != SignType::OPL)
+                return check_error(Errc::DANGLING_OPR_OPI, offsets, i,
+                                   "Dangling OPR / OPI");
+            break;
+        }
+    }
+    if (s == CheckState::MOD)
+        return check_error(Errc::INCOMPLETE_EXPR, offsets, 0,
+                           "Incomplete expression");
+    if (s == CheckState::NUL)
+        return check_error(Errc::EMPTY_EXPR, offsets, 0, "Empty expression");
+    return {};
+}
+
+void prog::check(const std::vector<expr::Token> &tokens) {
+    const auto err = verify(tokens);
+    if (err.code != expr::Errc::OK)
+        throw std::runtime_error(err.msg);
+}
+
+prog::Program prog::compile(const std::vector<expr::Token> &tokens) {
+    check(tokens);
+    return emit(tokens);
+}
+
+prog::Program prog::compile(const char *str, const env::Env *env) {
+    auto p = try_compile(str, env);
+    if (!p)
+        throw std::runtime_error(p.error().msg);
+    return std::move(p.value());
+}
+
+expr::Expected<prog::Program> prog::try_compile(const char *str,
+                                                const env::Env *env,
+                                                const expr::Budget *budget) {
+    std::vector<expr::Token> tokens;
+    std::vector<uint32_t> offsets;
+    const auto err = expr::lex(str, tokens, offsets, env, budget);
+    if (err.code != expr::Errc::OK)
+        return err;
+    return try_compile(tokens, offsets);
+}
+
+expr::Expected<prog::Program>
+prog::try_compile(const std::vector<expr::Token> &tokens,
+                  const std::vector<uint32_t> &offsets) {
+    const auto err = verify(tokens, &offsets);
+    if (err.code != expr::Errc::OK)
+        return err;
+    return emit(tokens);
+}
+
+expr::Expected<float> prog::try_eval(const char *str, const env::Env *env,
+                                     const expr::Budget *budget) {
+    Scratch &s = scratch();
+    auto err = expr::lex(str, s.tokens, s.offsets, env, budget);
+    if (err.code == expr::Errc::OK)
+        err = verify(s.tokens, &s.offsets);
+    if (err.code != expr::Errc::OK)
+        return err;
+
+    s.stack.clear();
+    Evaluator sink{s.stack, budget, 0, {}};
+    shunt(s.tokens, s.ops, sink);
+    if (sink.Stopped())
+        return sink.err;
+    return s.stack.back();
+}
+
+bool prog::valid(const View &v, const uint32_t n_pool) {
+    uint32_t cur = 0;
+    uint32_t peak = 0;
+    for (uint32_t i = 0; i < v.size; ++i) {
+        const Instr &in = v.code[i];
+        if (in.op == static_cast<uint8_t>(Sign::NONE)) {
+            if (in.arg >= n_pool)
+                return false;
+            peak = std::max(peak, ++cur);
+            continue;
+        }
+        if (in.op < expr::kMinSignOp ||
+            in.op >= expr::kMinSignOp + expr::kOpSize)
+            return false;
+        const uint32_t n_in = is_infix(in.op) ? 2 : 1;
+        if (cur < n_in)
+            return false;
+        cur -= n_in - 1;
+    }
+    return cur == 1 && peak == v.depth;
+}
+
+float prog::run(const View &v, float *stack) {
+    float *top = stack; // one past the top
+    for (uint32_t i = 0; i < v.size; ++i) {
+        const Instr &in = v.code[i];
+        if (in.op == static_cast<uint8_t>(Sign::NONE)) {
+            *top++ = v.pool[in.arg];
+            continue;
+        }
+        const auto fn = expr::kMapOp2Fn[in.op - expr::kMinSignOp];
+        if (is_infix(in.op)) {
+            --top;
+            top[-1] = fn(top[-1], *top);
+        } else {
+            top[-1] = fn(top[-1], expr::kFDummy);
+        }
+    }
+    return stack[0];
+}
+
+float prog::run(const View &v) {
+    if (v.depth <= kStackInline) {
+        std::array<float, kStackInline> stack;
+        return run(v, stack.data());
+    }
+    std::vector<float> stack(v.depth);
+    return run(v, stack.data());
+}
+
+float prog::eval(const char *str) { return run(compile(str).view()); }
+
+void prog::run_batch(const std::vector<View> &views, float *out,
+                     vmath::Accuracy acc) {
+    Batch &b = batch();
+    for (size_t i = 0; i < views.size(); i += kBatchBlock) {
+        const size_t n = std::min(kBatchBlock, views.size() - i);
+        run_block(views.data() + i, n, out + i, acc, b);
+    }
+}
+
+void prog::run_batch(const std::vector<View> &views, float *out) {
+    run_batch(views, out, vmath::get_accuracy());
+}
@@ -0,0 +1,95 @@
+// Assignments and multi-statement scripts
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+#include "par.hpp"
+#include "script.hpp"
+
+namespace {
+
+    // Run one statement, with `eval(str)` returning an `expr::Expected` of
+    // the value to bind in `env`
+    template <typename S, typename E, typename F>
+    expr::Expected<S> exec_with(const std::string &line, E &env, F eval) {
+        using script::Kind;
+        size_t i = 0;
+        while (i < line.size() &&
+               isspace(static_cast<unsigned char>(line[i])))
+            ++i;
+        if (i == line.size() || line[i] == '#')
+            return S{};
+
+        // `name =` with a single identifier, else the line is an expression
+        const size_t name_begin = i;
+        while (i < line.size() &&
+               isalpha(static_cast<unsigned char>(line[i])))
+            ++i;
+        const size_t name_end = i;
+        while (i < line.size() &&
+               isspace(static_cast<unsigned char>(line[i])))
+            ++i;
+        if (name_end == name_begin || i == line.size() || line[i] != '=') {
+            auto v = eval(line.c_str());
+            if (!v)
+                return v.error();
+            return S{Kind::EXPR, {}, v.value()};
+        }
+
+        const std::string_view name(line.data() + name_begin,
+                                    name_end - name_begin);
+        if (!env::is_name(name))
+            return expr::Error{expr::Errc::RESERVED_NAME,
+                               static_cast<uint32_t>(name_begin),
+                               "Reserved name"};
+        const size_t rhs = i + 1;
+        auto v = eval(line.c_str() + rhs);
+        if (!v) {
+            auto err = v.error();
+            err.offset += static_cast<uint32_t>(rhs);
+            return err;
+        }
+        env.Set(name, v.value());
+        return S{Kind::ASSIGN, name, v.value()};
+    }
+
+} // namespace
+
+expr::Expected<script::Stmt> script::exec(const std::string &line,
+                                          env::Env &env) {
+    return exec_with<Stmt>(line, env, [&](const char *str) {
+        return par::try_eval(str, {}, &env);
+    });
+}
+
+expr::Expected<script::ExactStmt>
+script::exec(const std::string &line, exact::Env &env, const bool exact) {
+    return exec_with<ExactStmt>(
+        line, env, [&](const char *str) -> expr::Expected<exact::Value> {
+            if (exact)
+                return exact::try_eval(str, &env);
+            auto v = par::try_eval(str, {}, &env.Floats());
+            if (!v)
+                return v.error();
+            return exact::Value::Real(v.value());
+        });
+}
+
+void script::run(std::istream &in, env::Env &env, std::ostream &out) {
+    std::string line;
+    for (size_t n = 1; std::getline(in, line); ++n) {
+        const auto r = exec(line, env);
+        if (!r)
+            throw std::runtime_error("Line " + std::to_string(n) + ": " +
+                                     r.error().msg);
+        if (r.value().kind == Kind::EXPR)
+            out << r.value().value << "\n";
+    }
+}
+
+void script::run(const std::string &path, env::Env &env, std::ostream &out) {
+    std::ifstream ifs(path);
+    if (!ifs)
+        throw std::runtime_error("Cannot open script: " + path);
+    run(ifs, env, out);
+}
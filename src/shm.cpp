@@ -0,0 +1,290 @@
+// Shared-memory rings and the evaluation loop serving them
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sched.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "prog.hpp"
+#include "shm.hpp"
+#include "sign.hpp"
+
+namespace {
+
+    static constexpr char kMagic[8] = {'S', 'C', 'I', 'C', 'S', 'H', 'M', 0};
+    static constexpr uint32_t kVersion = 1;
+    // polls before yielding or sleeping, on more than one CPU: on a single
+    // one the other side cannot make progress while this one polls
+    static constexpr uint32_t kSpinTries = 256;
+
+    uint32_t spin_tries() {
+        static const uint32_t n =
+            std::thread::hardware_concurrency() > 1 ? kSpinTries : 0;
+        return n;
+    }
+
+    // One ring position, on its own cache line. `waiting` is set by the
+    // side about to sleep on `event`, which the other side bumps to wake it
+    struct alignas(64) Cursor {
+        std::atomic<uint32_t> pos;
+        std::atomic<uint32_t> waiting;
+        std::atomic<uint32_t> event;
+    };
+
+    void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    // Cross-process futex: the region is shared, so not FUTEX_PRIVATE
+    void futex_wait(std::atomic<uint32_t> &word, const uint32_t seen) {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT,
+                seen, nullptr, nullptr, 0);
+#else
+        (void)word;
+        (void)seen;
+        sched_yield();
+#endif
+    }
+
+    void futex_wake(std::atomic<uint32_t> &word) {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE,
+                INT_MAX, nullptr, nullptr, 0);
+#else
+        (void)word;
+#endif
+    }
+
+    // Wake the other side if it sleeps on `c`. The state change before
+    // this call and the store to `waiting` before its last `ready` check
+    // are both sequentially consistent, so one of the two sees the other
+    void signal(Cursor &c) {
+        if (c.waiting.load()) {
+            c.event.fetch_add(1);
+            futex_wake(c.event);
+        }
+    }
+
+    // Block until `ready()`, which only turns true once the other side
+    // moved `c` or closed the channel
+    template <typename Ready>
+    void await(Cursor &c, const Ready &ready, const shm::Wait w) {
+        const uint32_t spins = spin_tries();
+        for (uint32_t i = 0; !ready(); ++i) {
+            if (i < spins) {
+                cpu_relax();
+            } else if (w == shm::Wait::SPIN) {
+                sched_yield();
+            } else {
+                const uint32_t seen = c.event.load();
+                c.waiting.store(1);
+                if (!ready())
+                    futex_wait(c.event, seen);
+                c.waiting.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t region_len(const size_t hdr, const uint32_t slots) {
+        return hdr + slots * (sizeof(shm::Request) + sizeof(shm::Response));
+    }
+
+} // namespace
+
+struct shm::Channel::Region {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots; // a power of two
+    std::atomic<uint32_t> closed;
+    Cursor req_head;  // moved by the client
+    Cursor req_tail;  // moved by the server
+    Cursor resp_head; // moved by the server
+    Cursor resp_tail; // moved by the client
+};
+
+shm::Channel::Channel(std::string name, const bool owner, void *base,
+                      const size_t len)
+    : name_(std::move(name)), owner_(owner), base_(base), len_(len),
+      hdr_(static_cast<Region *>(base)),
+      req_(reinterpret_cast<Request *>(static_cast<char *>(base) +
+                                       sizeof(Region))),
+      resp_(reinterpret_cast<Response *>(
+          static_cast<char *>(base) + sizeof(Region) +
+          hdr_->slots * sizeof(Request))) {}
+
+shm::Channel shm::Channel::Create(const std::string &name, uint32_t slots) {
+    slots = std::bit_ceil(std::max<uint32_t>(slots, 1));
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Cannot create shared memory: " + name);
+    const size_t len = region_len(sizeof(Region), slots);
+    if (ftruncate(fd, static_cast<off_t>(len)) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Cannot size shared memory: " + name);
+    }
+    void *base =
+        mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Cannot map shared memory: " + name);
+    }
+
+    // the mapping is zero-filled, i.e. all cursors at 0
+    auto *hdr = new (base) Region{};
+    hdr->version = kVersion;
+    hdr->slots = slots;
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(hdr->magic, kMagic, sizeof(kMagic));
+    return Channel(name, true, base, len);
+}
+
+shm::Channel shm::Channel::Open(const std::string &name) {
+    const int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open shared memory: " + name);
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(Region)) {
+        close(fd);
+        throw std::runtime_error("Not a scicalc channel: " + name);
+    }
+    const auto len = static_cast<size_t>(st.st_size);
+    void *base =
+        mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        throw std::runtime_error("Cannot map shared memory: " + name);
+
+    const auto *hdr = static_cast<const Region *>(base);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (std::memcmp(hdr->magic, kMagic, sizeof(kMagic)) != 0 ||
+        hdr->version != kVersion || !std::has_single_bit(hdr->slots) ||
+        region_len(sizeof(Region), hdr->slots) != len) {
+        munmap(base, len);
+        throw std::runtime_error("Not a scicalc channel: " + name);
+    }
+    return Channel(name, false, base, len);
+}
+
+shm::Channel::Channel(Channel &&o) noexcept
+    : name_(std::move(o.name_)), owner_(std::exchange(o.owner_, false)),
+      base_(std::exchange(o.base_, nullptr)), len_(o.len_), hdr_(o.hdr_),
+      req_(o.req_), resp_(o.resp_) {}
+
+shm::Channel::~Channel() {
+    if (base_ != nullptr)
+        munmap(base_, len_);
+    if (owner_)
+        shm_unlink(name_.c_str());
+}
+
+uint32_t shm::Channel::Slots() const { return hdr_->slots; }
+
+bool shm::Channel::TrySend(const uint64_t tag, const std::string_view expr) {
+    if (expr.size() > kMaxText)
+        throw std::runtime_error("Expression too long for shared memory");
+    const uint32_t head = hdr_->req_head.pos.load(std::memory_order_relaxed);
+    const uint32_t tail = hdr_->req_tail.pos.load(std::memory_order_acquire);
+    if (head - tail == hdr_->slots)
+        return false;
+    Request &r = req_[head & (hdr_->slots - 1)];
+    r.tag = tag;
+    r.len = static_cast<uint32_t>(expr.size());
+    std::memcpy(r.text, expr.data(), expr.size());
+    r.text[expr.size()] = '\0';
+    hdr_->req_head.pos.store(head + 1);
+    signal(hdr_->req_head);
+    return true;
+}
+
+void shm::Channel::Send(const uint64_t tag, const std::string_view expr,
+                        const Wait w) {
+    const uint32_t head = hdr_->req_head.pos.load(std::memory_order_relaxed);
+    await(
+        hdr_->req_tail,
+        [&] { return head - hdr_->req_tail.pos.load() != hdr_->slots; }, w);
+    TrySend(tag, expr);
+}
+
+bool shm::Channel::TryRecv(Response &r) {
+    const uint32_t tail = hdr_->resp_tail.pos.load(std::memory_order_relaxed);
+    const uint32_t head = hdr_->resp_head.pos.load(std::memory_order_acquire);
+    if (head == tail)
+        return false;
+    r = resp_[tail & (hdr_->slots - 1)];
+    hdr_->resp_tail.pos.store(tail + 1);
+    signal(hdr_->resp_tail);
+    return true;
+}
+
+void shm::Channel::Recv(Response &r, const Wait w) {
+    const uint32_t tail = hdr_->resp_tail.pos.load(std::memory_order_relaxed);
+    await(
+        hdr_->resp_head, [&] { return hdr_->resp_head.pos.load() != tail; },
+        w);
+    TryRecv(r);
+}
+
+void shm::Channel::Close() {
+    hdr_->closed.store(1);
+    signal(hdr_->req_head);
+}
+
+uint64_t shm::Channel::Serve(const Wait w, const env::Env *env) {
+    Region &h = *hdr_;
+    const uint32_t mask = h.slots - 1;
+    uint64_t n = 0;
+    while (true) {
+        uint32_t tail = h.req_tail.pos.load(std::memory_order_relaxed);
+        await(
+            h.req_head,
+            [&] { return h.req_head.pos.load() != tail || h.closed.load(); },
+            w);
+        const uint32_t head = h.req_head.pos.load(std::memory_order_acquire);
+        if (head == tail)
+            return n; // closed and drained
+
+        for (; tail != head; ++tail, ++n) {
+            const uint32_t out = h.resp_head.pos.load(std::memory_order_relaxed);
+            await(
+                h.resp_tail,
+                [&] { return out - h.resp_tail.pos.load() != h.slots; }, w);
+
+            // the text stays where the client wrote it
+            Request &rq = req_[tail & mask];
+            rq.text[std::min<size_t>(rq.len, kMaxText)] = '\0';
+            const auto v = prog::try_eval(rq.text, env);
+            Response &rs = resp_[out & mask];
+            rs.tag = rq.tag;
+            rs.value = v ? v.value() : expr::kFNan;
+            rs.offset = v ? 0 : static_cast<uint32_t>(v.error().offset);
+            rs.code = v ? expr::Errc::OK : v.error().code;
+
+            h.resp_head.pos.store(out + 1);
+            signal(h.resp_head);
+            h.req_tail.pos.store(tail + 1);
+            signal(h.req_tail);
+        }
+    }
+}
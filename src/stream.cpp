@@ -0,0 +1,275 @@
+// Chunked lexer and incremental shunting-yard over a single expression
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <utility>
+
+#include "env.hpp"
+#include "sign.hpp"
+#include "stream.hpp"
+
+namespace {
+
+    using expr::Errc;
+    using expr::Sign;
+    using expr::SignType;
+
+    // Pop the operands of `op` and push its value, as `prog::try_eval` does
+    void apply(std::vector<float> &stack, const uint8_t op) {
+        const auto fn = expr::kMapOp2Fn[op - expr::kMinSignOp];
+        if (expr::sign2optype(op) == SignType::OPI) {
+            const float b = stack.back();
+            stack.pop_back();
+            stack.back() = fn(stack.back(), b);
+        } else {
+            stack.back() = fn(stack.back(), expr::kFDummy);
+        }
+    }
+
+} // namespace
+
+bool stream::Evaluator::Feed(const char *data, const size_t len) {
+    const uint64_t base = pos_;
+    pos_ += len;
+    if (err_.code != Errc::OK)
+        return false;
+
+    for (size_t i = 0; i < len; ++i) {
+        const auto c = static_cast<unsigned char>(data[i]);
+        if (kind_ == Lexeme::NUM && (std::isdigit(c) || c == '.')) {
+            lexeme_ += static_cast<char>(c);
+            continue;
+        }
+        if (kind_ == Lexeme::IDENT && std::isalpha(c)) {
+            lexeme_ += static_cast<char>(c);
+            continue;
+        }
+        if (kind_ != Lexeme::NONE)
+            EndLexeme();
+        if (err_.code != Errc::OK)
+            return false;
+        if (std::isspace(c))
+            continue;
+
+        const uint64_t off = base + i;
+        if (std::isdigit(c) || std::isalpha(c)) {
+            kind_ = std::isdigit(c) ? Lexeme::NUM : Lexeme::IDENT;
+            lexeme_.assign(1, static_cast<char>(c));
+            lexeme_off_ = off;
+        } else {
+            // a leading `.` is an unknown operator too, as in `expr::lex`
+            const uint8_t sign = expr::chr2sign(static_cast<char>(c));
+            if (sign == static_cast<uint8_t>(Sign::NONE))
+                Fail(Errc::UNKNOWN_OP, off, "Unknown operator");
+            else
+                Push(sign, 0, off);
+        }
+        if (err_.code != Errc::OK)
+            return false;
+    }
+    return true;
+}
+
+expr::Expected<float> stream::Evaluator::Finish() {
+    if (err_.code == Errc::OK && kind_ != Lexeme::NONE)
+        EndLexeme();
+    if (err_.code != Errc::OK)
+        return err_;
+    if (first_)
+        return expr::Error{Errc::EMPTY_STRING, 0, "Empty string"};
+    if (calls_.Pending())
+        return expr::Error{Errc::BAD_CALL, pos_, "Misplaced call or comma"};
+    if (lpar_ > 0)
+        return expr::Error{Errc::UNMATCHED_LPAR, pos_,
+                           "Unmatched left parenthesis"};
+    if (empty_)
+        return expr::Error{Errc::EMPTY_EXPR, 0, "Empty expression"};
+    if (!operand_)
+        return expr::Error{Errc::UNFINISHED_EXPR, last_,
+                           "Unfinished expression"};
+    Flush(0);
+    return stack_.back();
+}
+
+void stream::Evaluator::Reset() {
+    err_ = {};
+    pos_ = 0;
+    lexeme_.clear();
+    kind_ = Lexeme::NONE;
+    lexeme_off_ = 0;
+    last_ = 0;
+    first_ = true;
+    operand_ = false;
+    empty_ = true;
+    lpar_ = 0;
+    calls_ = {};
+    ops_.clear();
+    stack_.clear();
+    peak_ = 0;
+}
+
+void stream::Evaluator::EndLexeme() {
+    const Lexeme kind = std::exchange(kind_, Lexeme::NONE);
+    if (kind == Lexeme::NUM) {
+        const int val = expr::digits2num(lexeme_.data(), lexeme_.size());
+        Push(static_cast<uint8_t>(Sign::NONE), static_cast<float>(val),
+             lexeme_off_);
+        return;
+    }
+
+    const uint8_t sign = expr::ident2sign(lexeme_.data(), lexeme_.size());
+    const float *bound = nullptr;
+    if (sign == static_cast<uint8_t>(Sign::NONE) && env_ != nullptr)
+        bound = env_->Find(lexeme_);
+    if (bound != nullptr)
+        Push(static_cast<uint8_t>(Sign::NONE), *bound, lexeme_off_);
+    else if (sign == static_cast<uint8_t>(Sign::NONE))
+        Fail(Errc::UNKNOWN_FN, lexeme_off_, "Unknown function");
+    else if (expr::sign2optype(sign) == SignType::CON)
+        Push(static_cast<uint8_t>(Sign::NONE),
+             expr::kMapConst2Real[sign - expr::kMinSignConst], lexeme_off_);
+    else
+        Push(sign, 0, lexeme_off_);
+}
+
+// Same token rules as `expr::lex` and the same grammar as `prog::verify`,
+// checked forwards: an operand is a run of OPR, a number and a run of OPL,
+// and operands are separated by OPI
+void stream::Evaluator::Push(uint8_t sign, const float num,
+                             const uint64_t off) {
+    // Change the starting + or - sign to unary
+    if (first_ && sign == static_cast<uint8_t>(Sign::SUB))
+        sign = static_cast<uint8_t>(Sign::USB);
+    else if (first_ && sign == static_cast<uint8_t>(Sign::ADD))
+        sign = static_cast<uint8_t>(Sign::UAD);
+    first_ = false;
+
+    if (calls_.Pending() && sign != static_cast<uint8_t>(Sign::PAL)) {
+        Fail(Errc::BAD_CALL, off, "Misplaced call or comma");
+        return;
+    }
+    if (sign == static_cast<uint8_t>(Sign::PAL)) {
+        calls_.Enter(++lpar_);
+        return;
+    }
+    if (sign == static_cast<uint8_t>(Sign::PAR)) {
+        if (lpar_ == 0)
+            Fail(Errc::UNMATCHED_RPAR, off, "Unmatched right parenthesis");
+        else if (!calls_.Leave(lpar_))
+            Fail(Errc::BAD_CALL, off, "Misplaced call or comma");
+        else
+            --lpar_;
+        return;
+    }
+    if (expr::is_call(sign)) {
+        calls_.Open(sign); // only its `,` are tokens
+        return;
+    }
+    uint8_t level = lpar_;
+    if (sign == static_cast<uint8_t>(Sign::CMA)) {
+        sign = calls_.Comma(lpar_);
+        if (sign == static_cast<uint8_t>(Sign::NONE)) {
+            Fail(Errc::BAD_CALL, off, "Misplaced call or comma");
+            return;
+        }
+        --level; // binds as the call's operator one level out
+    }
+
+    const SignType t = sign == static_cast<uint8_t>(Sign::NONE)
+                           ? SignType::NONE
+                           : expr::sign2optype(sign);
+    // the next token must extend or follow the operand
+    const bool want_operand = t == SignType::NONE || t == SignType::OPR;
+    if (want_operand && operand_) {
+        Fail(Errc::DANGLING_NUM_OPL, off, "Dangling NUM / OPL");
+        return;
+    }
+    if (!want_operand && !operand_) {
+        if (empty_)
+            Fail(Errc::INCOMPLETE_EXPR, off, "Incomplete expression");
+        else
+            Fail(Errc::DANGLING_OPR_OPI, off, "Dangling OPR / OPI");
+        return;
+    }
+    empty_ = false;
+    last_ = off;
+
+    if (t == SignType::NONE) {
+        stack_.push_back(num);
+        operand_ = true;
+    } else {
+        auto [bpl, bpr] = expr::kMapOp2Bp[sign - expr::kMinSignOp];
+        bpl = (bpl == 0) ? 0 : bpl + level * expr::kBpDelta;
+        bpr = (bpr == 0) ? 0 : bpr + level * expr::kBpDelta;
+        if (t == SignType::OPR) {
+            ops_.push_back({sign, bpl, bpr, {0}});
+        } else if (t == SignType::OPL) {
+            Flush(bpl);
+            apply(stack_, sign);
+        } else {
+            Flush(bpl);
+            ops_.push_back({sign, bpl, bpr, {0}});
+            operand_ = false;
+        }
+    }
+    peak_ = std::max(peak_, ops_.size() + stack_.size());
+}
+
+// Emit the pending operators binding at least as tight as `lbp`, the rule of
+// `prog`'s shunting-yard
+void stream::Evaluator::Flush(const uint8_t lbp) {
+    while (!ops_.empty() && ops_.back().rbp >= lbp) {
+        apply(stack_, ops_.back().v);
+        ops_.pop_back();
+    }
+}
+
+void stream::Evaluator::Fail(const Errc code, const uint64_t off,
+                             const char *msg) {
+    err_ = {code, off, msg};
+}
+
+expr::Expected<float> stream::try_eval(std::istream &in, const env::Env *env,
+                                       const size_t chunk) {
+    Evaluator ev(env);
+    std::vector<char> buf(std::max<size_t>(chunk, 1));
+    while (in.read(buf.data(), static_cast<std::streamsize>(buf.size())) ||
+           in.gcount() > 0) {
+        if (!ev.Feed(buf.data(), static_cast<size_t>(in.gcount())))
+            break;
+    }
+    if (in.bad())
+        return expr::Error{Errc::IO_ERROR, ev.Size(), "Cannot read input"};
+    return ev.Finish();
+}
+
+expr::Expected<float> stream::try_eval(const int fd, const env::Env *env,
+                                       const size_t chunk) {
+    Evaluator ev(env);
+    std::vector<char> buf(std::max<size_t>(chunk, 1));
+    while (true) {
+        const ssize_t n = read(fd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return expr::Error{Errc::IO_ERROR, ev.Size(), "Cannot read input"};
+        if (n == 0 || !ev.Feed(buf.data(), static_cast<size_t>(n)))
+            break;
+    }
+    return ev.Finish();
+}
+
+float stream::eval(const std::string &path) {
+    const int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open file: " + path);
+    const auto v = try_eval(fd);
+    if (fd != STDIN_FILENO)
+        close(fd);
+    if (!v)
+        throw std::runtime_error(v.error().msg);
+    return v.value();
+}
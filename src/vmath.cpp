@@ -0,0 +1,229 @@
+// Array kernels for log, pow and tgamma with selectable accuracy
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+
+#include "vmath.hpp"
+
+namespace {
+
+    using vmath::Accuracy;
+
+    static constexpr double kLn2 = 0.6931471805599453;
+    // ln2 split so that `k * kLn2Hi` is exact for |k| < 2^20
+    static constexpr double kLn2Hi = 6.93147180369123816490e-01;
+    static constexpr double kLn2Lo = 1.90821492927058770002e-10;
+    static constexpr double kLog2e = 1.4426950408889634;
+    static constexpr double kSqrt2 = 1.4142135623730951;
+    static constexpr double kSqrt2Pi = 2.5066282746310002;
+    // adding and subtracting rounds a double to the nearest integer
+    static constexpr double kRoundShift = 0x1.8p52;
+    // `exp_d` input range, wide enough to over- and underflow a float
+    static constexpr double kExpMax = 200.0;
+
+    // tgamma runs through Lanczos on [kGammaMin, kGammaMax]; below that it
+    // needs the reflection formula and above that a float overflows anyway
+    static constexpr float kGammaMin = 0.5f;
+    static constexpr float kGammaMax = 40.0f;
+
+    // Lanczos coefficients, g = 7, n = 9 (relative error ~1e-15)
+    static constexpr std::array<double, 9> kLanczos9{
+        0.99999999999980993,     676.5203681218851,
+        -1259.1392167224028,     771.32342877765313,
+        -176.61502916214059,     12.507343278686905,
+        -0.13857109526572012,    9.9843695780195716e-6,
+        1.5056327351493116e-7,
+    };
+    static constexpr double kLanczos9G = 7.0;
+
+    // Lanczos coefficients, g = 5, n = 6 (relative error < 2e-10)
+    static constexpr std::array<double, 7> kLanczos6{
+        1.000000000190015,   76.18009172947146,     -86.50532032941677,
+        24.01409824083091,   -1.231739572450155,    0.1208650973866179e-2,
+        -0.5395239384953e-5,
+    };
+    static constexpr double kLanczos6G = 5.0;
+
+    thread_local Accuracy tl_accuracy = Accuracy::EXACT;
+
+    // 1 / k! for the exp polynomial
+    static constexpr std::array<double, 16> kInvFact = [] {
+        std::array<double, 16> c{};
+        double f = 1;
+        for (size_t k = 0; k < c.size(); ++k) {
+            f *= k > 0 ? static_cast<double>(k) : 1.0;
+            c[k] = 1 / f;
+        }
+        return c;
+    }();
+
+    // The bit manipulations below only use shifts, masks and adds on 64-bit
+    // lanes, which SSE2 has, instead of int64 <-> double conversions, which
+    // it does not.
+
+    // log of a positive normal double: x = m * 2^e with m in [sqrt(1/2),
+    // sqrt(2)), log(m) = 2 atanh(s) = 2 (s + s^3 / 3 + s^5 / 5 + ...) with
+    // s = (m - 1) / (m + 1), summing `K` terms
+    template <int K> inline double log_d(const double x) {
+        const uint64_t bits = std::bit_cast<uint64_t>(x);
+        // biased exponent as the low bits of 2^52, read back as a double
+        double e = std::bit_cast<double>((bits >> 52) | 0x4330000000000000ULL) -
+                   (0x1p52 + 1023);
+        double m = std::bit_cast<double>((bits & 0x000fffffffffffffULL) |
+                                         0x3ff0000000000000ULL);
+        const bool hi = m > kSqrt2;
+        m = hi ? m * 0.5 : m;
+        e = hi ? e + 1 : e;
+
+        const double s = (m - 1) / (m + 1);
+        const double s2 = s * s;
+        double p = 1.0 / (2 * K - 1);
+        for (int k = K - 2; k >= 0; --k)
+            p = p * s2 + 1.0 / (2 * k + 1);
+        return e * kLn2 + 2 * s * p;
+    }
+
+    // exp with x = k ln2 + r, |r| <= ln2 / 2, and a Taylor polynomial of
+    // degree `D` for exp(r)
+    template <int D> inline double exp_d(double x) {
+        static_assert(D < static_cast<int>(kInvFact.size()));
+        x = std::min(std::max(x, -kExpMax), kExpMax);
+        // k ends up in the low mantissa bits of `shifted`
+        const double shifted = x * kLog2e + kRoundShift;
+        const double k = shifted - kRoundShift;
+        const double r = (x - k * kLn2Hi) - k * kLn2Lo;
+
+        double p = kInvFact[D];
+        for (int d = D - 1; d >= 0; --d)
+            p = p * r + kInvFact[d];
+        const auto scale = std::bit_cast<double>(
+            (std::bit_cast<uint64_t>(shifted) + 1023) << 52);
+        return p * scale;
+    }
+
+    template <int K> void log_main(const float *x, float *out, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            const bool ok = (x[i] >= FLT_MIN) & (x[i] <= FLT_MAX);
+            out[i] = static_cast<float>(log_d<K>(ok ? x[i] : 1.0f));
+        }
+    }
+
+    // pow(x, y) = sign * exp(y log|x|), negative bases only with integral
+    // exponents
+    template <int K, int D>
+    void pow_main(const float *x, const float *y, float *out, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            const double xd = x[i];
+            const double yd = y[i];
+            const double ax = xd < 0 ? -xd : xd;
+            const bool ok = (ax >= FLT_MIN) & (ax <= FLT_MAX);
+            const double t = yd * log_d<K>(ok ? ax : 1.0);
+            // odd y keeps the sign of x: y is odd if y / 2 is not an integer,
+            // which past 2^51 it always is
+            const double half = std::min(std::max(yd * 0.5, -0x1p51), 0x1p51);
+            const double sign =
+                ((half + kRoundShift) - kRoundShift) != half ? xd : 1.0;
+            const double r = exp_d<D>(t);
+            out[i] = static_cast<float>(std::copysign(r, sign));
+        }
+    }
+
+    // Lanczos approximation for x in [kGammaMin, kGammaMax]
+    template <size_t N, int K, int D>
+    void tgamma_main(const float *x, float *out, size_t n,
+                     const std::array<double, N> &coef, const double g) {
+        for (size_t i = 0; i < n; ++i) {
+            const bool ok = (x[i] >= kGammaMin) & (x[i] <= kGammaMax);
+            const double z = static_cast<double>(ok ? x[i] : 1.0f) - 1.0;
+            double a = coef[0];
+            for (size_t j = 1; j < N; ++j)
+                a += coef[j] / (z + j);
+            const double t = z + g + 0.5;
+            const double lg = (z + 0.5) * log_d<K>(t) - t;
+            out[i] = static_cast<float>(kSqrt2Pi * exp_d<D>(lg) * a);
+        }
+    }
+
+} // namespace
+
+vmath::Accuracy vmath::get_accuracy() { return tl_accuracy; }
+
+void vmath::set_accuracy(Accuracy acc) { tl_accuracy = acc; }
+
+void vmath::log(const float *x, float *out, size_t n, Accuracy acc) {
+    switch (acc) {
+    case Accuracy::EXACT:
+        for (size_t i = 0; i < n; ++i)
+            out[i] = std::log(x[i]);
+        return;
+    case Accuracy::ULP1:
+        log_main<8>(x, out, n);
+        break;
+    case Accuracy::ULP4:
+        log_main<4>(x, out, n);
+        break;
+    }
+    for (size_t i = 0; i < n; ++i)
+        if (!(x[i] >= FLT_MIN && x[i] <= FLT_MAX))
+            out[i] = static_cast<float>(std::log(static_cast<double>(x[i])));
+}
+
+void vmath::pow(const float *x, const float *y, float *out, size_t n,
+                Accuracy acc) {
+    switch (acc) {
+    case Accuracy::EXACT:
+        for (size_t i = 0; i < n; ++i)
+            out[i] = std::pow(x[i], y[i]);
+        return;
+    case Accuracy::ULP1:
+        pow_main<10, 11>(x, y, out, n);
+        break;
+    case Accuracy::ULP4:
+        pow_main<7, 8>(x, y, out, n);
+        break;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const float ax = std::fabs(x[i]);
+        const bool ok = ax >= FLT_MIN && ax <= FLT_MAX &&
+                        std::fabs(y[i]) <= FLT_MAX &&
+                        (x[i] > 0 || std::trunc(y[i]) == y[i]);
+        if (!ok)
+            out[i] = static_cast<float>(std::pow(static_cast<double>(x[i]),
+                                                 static_cast<double>(y[i])));
+    }
+}
+
+void vmath::tgamma(const float *x, float *out, size_t n, Accuracy acc) {
+    switch (acc) {
+    case Accuracy::EXACT:
+        for (size_t i = 0; i < n; ++i)
+            out[i] = std::tgamma(x[i]);
+        return;
+    case Accuracy::ULP1:
+        tgamma_main<kLanczos9.size(), 10, 11>(x, out, n, kLanczos9,
+                                              kLanczos9G);
+        break;
+    case Accuracy::ULP4:
+        tgamma_main<kLanczos6.size(), 7, 8>(x, out, n, kLanczos6,
+                                            kLanczos6G);
+        break;
+    }
+    for (size_t i = 0; i < n; ++i)
+        if (!(x[i] >= kGammaMin && x[i] <= kGammaMax))
+            out[i] = static_cast<float>(std::tgamma(static_cast<double>(x[i])));
+}
+
+uint32_t vmath::ulp_diff(float a, float b) {
+    if (std::isnan(a) || std::isnan(b))
+        return std::isnan(a) && std::isnan(b) ? 0 : UINT32_MAX;
+    // map the sign-magnitude encoding onto a monotonic integer line
+    auto ordered = [](const float f) {
+        const auto u = std::bit_cast<int32_t>(f);
+        return u < 0 ? static_cast<int64_t>(INT32_MIN) - u
+                     : static_cast<int64_t>(u);
+    };
+    const int64_t d = ordered(a) - ordered(b);
+    return static_cast<uint32_t>(d < 0 ? -d : d);
+}
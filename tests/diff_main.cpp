@@ -0,0 +1,525 @@
+// Differential test: every evaluation path against the reference chain
+// reduction `expr::eval`, on seeded quizzes, quizzes wrapped in function
+// calls and malformed strings. Prints the throughput of each path and a
+// shrunk reproducer per mismatching path. `exact::eval` rounds once at the
+// end rather than per operation, so only its errors are compared
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "cache.hpp"
+#include "exam.hpp"
+#include "exact.hpp"
+#include "expr.hpp"
+#include "image.hpp"
+#include "memo.hpp"
+#include "par.hpp"
+#include "pool.hpp"
+#include "prog.hpp"
+#include "stream.hpp"
+#include "vmath.hpp"
+
+namespace {
+
+    static constexpr uint64_t kCases = 1000000;
+    static constexpr uint64_t kSeed = 38;
+    static constexpr size_t kBlock = 4096;
+    // quizzes left intact, in percent; the rest is mutated or random junk
+    static constexpr uint32_t kValidPct = 70;
+    static constexpr uint32_t kJunkPct = 5;
+    // cases with a single `vmath` operator, in percent of the valid ones
+    static constexpr uint32_t kKernelPct = 10;
+    // quizzes wrapped in `sin`, `min`, ... calls, in percent of the others
+    static constexpr uint32_t kCallPct = 20;
+    // the reference, `std::tgamma` and the like, is not always correctly
+    // rounded either
+    static constexpr uint32_t kUlpSlack = 1;
+
+    struct Outcome {
+        bool ok = false;
+        float value = 0;
+        std::string err; // message, if not `ok`
+    };
+
+    using Runner = void (*)(const std::vector<std::string> &,
+                            std::vector<Outcome> &);
+
+    struct Path {
+        const char *name;
+        Runner run;
+        uint32_t max_ulp; // 0 for bit for bit, any NaN matching any NaN
+        bool same_error;  // the message too, not only that it fails
+        uint32_t every;   // run on every n-th block only, for slow paths
+        // Only compare cases with a single `vmath` operator. Approximate
+        // kernels are within a few ULP per operation, but through a whole
+        // quiz the error grows without bound, e.g. `(2!*15)!` amplifies it
+        // a hundredfold, and `(0-5!)!` is NaN or 0 depending on one ULP
+        bool kernel_only;
+        bool errors_only; // whether it fails, and with which message
+    };
+
+    struct Tally {
+        double secs = 0;    // spent in `Path::run`
+        uint64_t n = 0;     // cases run
+        uint64_t n_bad = 0; // cases mismatching the reference
+        uint32_t worst = 0; // largest ULP distance of a finite value
+        std::string first;  // first mismatching case
+    };
+
+    Outcome fail(const char *msg) { return {false, 0, msg}; }
+
+    void run_ref(const std::vector<std::string> &in, std::vector<Outcome> &out) {
+        for (size_t i = 0; i < in.size(); ++i) {
+            try {
+                out[i] = {true, expr::eval(in[i].c_str()), {}};
+            } catch (const std::runtime_error &ex) {
+                out[i] = fail(ex.what());
+            }
+        }
+    }
+
+    // the `expr::lex` front end under an unlimited budget
+    void run_budget(const std::vector<std::string> &in,
+                    std::vector<Outcome> &out) {
+        static constexpr expr::Budget kUnlimited{};
+        for (size_t i = 0; i < in.size(); ++i) {
+            try {
+                out[i] = {true, expr::eval(in[i].c_str(), kUnlimited), {}};
+            } catch (const std::runtime_error &ex) {
+                out[i] = fail(ex.what());
+            }
+        }
+    }
+
+    void run_try_eval(const std::vector<std::string> &in,
+                      std::vector<Outcome> &out) {
+        for (size_t i = 0; i < in.size(); ++i) {
+            const auto v = prog::try_eval(in[i].c_str());
+            out[i] = v ? Outcome{true, v.value(), {}} : fail(v.error().msg);
+        }
+    }
+
+    // Compile every case, reporting errors in `out`; the programs of the
+    // valid ones are returned along with their indices
+    void compile_all(const std::vector<std::string> &in,
+                     std::vector<Outcome> &out,
+                     std::vector<prog::Program> &progs,
+                     std::vector<size_t> &idx) {
+        progs.clear();
+        idx.clear();
+        for (size_t i = 0; i < in.size(); ++i) {
+            auto p = prog::try_compile(in[i].c_str());
+            if (!p) {
+                out[i] = fail(p.error().msg);
+                continue;
+            }
+            progs.push_back(std::move(p.value()));
+            idx.push_back(i);
+        }
+    }
+
+    void run_prog(const std::vector<std::string> &in,
+                  std::vector<Outcome> &out) {
+        std::vector<prog::Program> progs;
+        std::vector<size_t> idx;
+        compile_all(in, out, progs, idx);
+        for (size_t j = 0; j < progs.size(); ++j)
+            out[idx[j]] = {true, prog::run(progs[j].view()), {}};
+    }
+
+    template <vmath::Accuracy Acc>
+    void run_batch(const std::vector<std::string> &in,
+                   std::vector<Outcome> &out) {
+        std::vector<prog::Program> progs;
+        std::vector<size_t> idx;
+        compile_all(in, out, progs, idx);
+        std::vector<prog::View> views;
+        for (const auto &p : progs)
+            views.push_back(p.view());
+        std::vector<float> res(views.size());
+        prog::run_batch(views, res.data(), Acc);
+        for (size_t j = 0; j < res.size(); ++j)
+            out[idx[j]] = {true, res[j], {}};
+    }
+
+    void run_memo(const std::vector<std::string> &in,
+                  std::vector<Outcome> &out) {
+        // shared across blocks, as in a long-running batch
+        static memo::Table t;
+        std::vector<prog::Program> progs;
+        std::vector<size_t> idx;
+        compile_all(in, out, progs, idx);
+        for (size_t j = 0; j < progs.size(); ++j)
+            out[idx[j]] = {true, memo::run(progs[j].view(), t), {}};
+    }
+
+    void run_image(const std::vector<std::string> &in,
+                   std::vector<Outcome> &out) {
+        static const std::string path =
+            (std::filesystem::temp_directory_path() /
+             ("scicalc_diff_" + std::to_string(getpid()) + ".img"))
+                .string();
+        std::vector<prog::Program> progs;
+        std::vector<size_t> idx;
+        compile_all(in, out, progs, idx);
+        std::vector<std::string> srcs;
+        for (const size_t i : idx)
+            srcs.push_back(in[i]);
+        if (srcs.empty())
+            return;
+        image::write(path, srcs);
+        const image::Image img(path);
+        for (uint32_t j = 0; j < img.Size(); ++j)
+            out[idx[j]] = {true, img.Eval(j), {}};
+        std::filesystem::remove(path);
+    }
+
+    void run_exact(const std::vector<std::string> &in,
+                   std::vector<Outcome> &out) {
+        for (size_t i = 0; i < in.size(); ++i) {
+            try {
+                out[i] = {true, exact::eval(in[i].c_str()).ToFloat(), {}};
+            } catch (const std::runtime_error &ex) {
+                out[i] = fail(ex.what());
+            }
+        }
+    }
+
+    // Through one cache file for the whole run, which is removed at exit.
+    // Error offsets are those of the normalized text, messages are the same
+    void run_cache(const std::vector<std::string> &in,
+                   std::vector<Outcome> &out) {
+        struct File {
+            std::string path = (std::filesystem::temp_directory_path() /
+                                ("scicalc_diff_" + std::to_string(getpid()) +
+                                 ".cache"))
+                                   .string();
+            cache::Store store{path};
+            ~File() { std::filesystem::remove(path); }
+        };
+        static File f;
+        for (size_t i = 0; i < in.size(); ++i) {
+            const auto v = cache::eval(f.store, in[i]);
+            out[i] = v ? Outcome{true, v.value(), {}} : fail(v.error().msg);
+        }
+        f.store.Flush();
+    }
+
+    // Fed in 3-byte pieces so that most tokens straddle a boundary. Errors
+    // are the first from the left, so only their presence is compared
+    void run_stream(const std::vector<std::string> &in,
+                    std::vector<Outcome> &out) {
+        stream::Evaluator ev;
+        for (size_t i = 0; i < in.size(); ++i) {
+            ev.Reset();
+            const std::string &s = in[i];
+            for (size_t k = 0; k < s.size(); k += 3)
+                ev.Feed(s.data() + k, std::min<size_t>(3, s.size() - k));
+            const auto v = ev.Finish();
+            out[i] = v ? Outcome{true, v.value(), {}} : fail(v.error().msg);
+        }
+    }
+
+    // Split at every outermost operator, whatever the length
+    void run_par(const std::vector<std::string> &in,
+                 std::vector<Outcome> &out) {
+        static pool::Pool p(2);
+        par::Options opt;
+        opt.threshold = 0;
+        opt.pool = &p;
+        for (size_t i = 0; i < in.size(); ++i) {
+            const auto v = par::try_eval(in[i].c_str(), opt);
+            out[i] = v ? Outcome{true, v.value(), {}} : fail(v.error().msg);
+        }
+    }
+
+    bool same(const Path &p, const Outcome &ref, const Outcome &got) {
+        if (ref.ok != got.ok)
+            return false;
+        if (!ref.ok)
+            return !p.same_error || ref.err == got.err;
+        if (p.errors_only)
+            return true;
+        if (std::isnan(ref.value) || std::isnan(got.value))
+            return std::isnan(ref.value) && std::isnan(got.value);
+        if (std::isinf(ref.value) || std::isinf(got.value))
+            return ref.value == got.value;
+        return vmath::ulp_diff(ref.value, got.value) <= p.max_ulp;
+    }
+
+    bool mismatch(const Path &p, const std::string &s) {
+        const std::vector<std::string> in = {s};
+        std::vector<Outcome> ref(1), got(1);
+        run_ref(in, ref);
+        p.run(in, got);
+        return !same(p, ref[0], got[0]);
+    }
+
+    // Drop ever smaller pieces of `s` while the mismatch persists
+    std::string shrink(const Path &p, std::string s) {
+        for (size_t len = s.size() / 2; len > 0;) {
+            bool cut = false;
+            for (size_t at = 0; at + len <= s.size();) {
+                std::string t = s;
+                t.erase(at, len);
+                if (mismatch(p, t)) {
+                    s = std::move(t);
+                    cut = true;
+                } else {
+                    at += len;
+                }
+            }
+            if (!cut)
+                len /= 2;
+        }
+        return s;
+    }
+
+    std::string describe(const Outcome &o) {
+        if (!o.ok)
+            return "error: " + o.err;
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.9g (0x%08x)", o.value,
+                      std::bit_cast<uint32_t>(o.value));
+        return buf;
+    }
+
+    // One random edit of a quiz: a character inserted, dropped or replaced
+    void mutate(std::string &s, std::mt19937 &gen) {
+        static constexpr char kChars[] = "0123456789.+-*/^!(), lnpiex";
+        const char c = kChars[gen() % (sizeof(kChars) - 1)];
+        const size_t at = gen() % (s.size() + 1);
+        switch (gen() % 3) {
+        case 0:
+            s.insert(s.begin() + static_cast<ptrdiff_t>(at), c);
+            break;
+        case 1:
+            if (at < s.size())
+                s.erase(at, 1);
+            break;
+        default:
+            if (at < s.size())
+                s[at] = c;
+            break;
+        }
+    }
+
+    std::string junk(std::mt19937 &gen) {
+        static constexpr const char *kLexemes[] = {
+            "1", "23", "0", "4.5", "+", "-", "*", "/", "^", "!",
+            "(", ")", "ln", "pi", "e", " ", "$", "x",
+            "sin", "sqrt", "min(", "max", ",",
+        };
+        std::string s;
+        for (size_t n = gen() % 12; n > 0; --n)
+            s += kLexemes[gen() % std::size(kLexemes)];
+        return s;
+    }
+
+    // One operator with a `vmath` kernel on integer operands, including
+    // poles and overflow
+    std::string kernel(std::mt19937 &gen) {
+        const auto num = [&](const int lo, const int hi) {
+            const int v = lo + static_cast<int>(gen() % (hi - lo + 1));
+            return v < 0 ? "(0 - " + std::to_string(-v) + ")"
+                         : std::to_string(v);
+        };
+        switch (gen() % 3) {
+        case 0:
+            return num(-40, 40) + "!";
+        case 1:
+            return "ln " + num(-2, 100000);
+        default:
+            return num(-30, 30) + " ^ " + num(-40, 40);
+        }
+    }
+
+    // A call of one of the named functions on quizzes of `g`, nested up to
+    // `depth` levels, e.g. `max(sqrt(3 + 4), 2!, 5) * 2`
+    std::string call(const exam::Generator &g, std::mt19937 &gen,
+                     const int depth) {
+        static constexpr const char *kUnary[] = {"sin", "cos", "tan",
+                                                 "sqrt", "exp", "abs"};
+        const auto arg = [&] {
+            return depth > 1 && gen() % 2 == 0 ? call(g, gen, depth - 1)
+                                               : g.Expr(gen);
+        };
+        std::string s;
+        if (gen() % 2 == 0) {
+            s = kUnary[gen() % std::size(kUnary)];
+            if (gen() % 2 == 0) {
+                s += '(';
+                s += arg();
+                s += ')';
+            } else {
+                s += ' ';
+                s += g.Expr(gen);
+            }
+        } else {
+            s = gen() % 2 == 0 ? "min(" : "max(";
+            s += arg();
+            for (uint32_t k = 1 + gen() % 2; k > 0; --k) {
+                s += ", ";
+                s += arg();
+            }
+            s += ")";
+        }
+        switch (gen() % 3) {
+        case 0:
+            return s;
+        case 1:
+            return g.Expr(gen) + " - " + s;
+        default:
+            return s + " * " + g.Expr(gen);
+        }
+    }
+
+    void make_block(const uint64_t seed, const size_t n,
+                    std::vector<std::string> &out, std::vector<bool> &kern) {
+        // operands from 0 so that `ln 0` and `0/0` turn up
+        static const exam::Generator kGens[] = {
+            {"+, -, *, /, ^, !, ln", 1, 0, 9},
+            {"+, -, *, /, ^, !, ln", 3, 0, 9},
+            {"+, -, *, /, ^, !, ln", 6, 0, 20},
+            {"+, -, *, /", 10, 1, 99},
+        };
+        std::mt19937 gen(static_cast<std::mt19937::result_type>(seed));
+        out.resize(n);
+        kern.assign(n, false);
+        for (size_t i = 0; i < n; ++i) {
+            std::string &s = out[i];
+            const uint32_t pct = gen() % 100;
+            if (pct < kJunkPct) {
+                s = junk(gen);
+                continue;
+            }
+            if (pct < kJunkPct + kValidPct && gen() % 100 < kKernelPct) {
+                s = kernel(gen);
+                kern[i] = true;
+                continue;
+            }
+            const exam::Generator &g = kGens[gen() % std::size(kGens)];
+            s = gen() % 100 < kCallPct ? call(g, gen, 2) : g.Expr(gen);
+            if (pct >= kJunkPct + kValidPct)
+                for (uint32_t k = 1 + gen() % 2; k > 0; --k)
+                    mutate(s, gen);
+        }
+    }
+
+    using vmath::Accuracy;
+    static constexpr Path kRef = {
+        "expr::eval", run_ref, 0, true, 1, false, false};
+    static constexpr Path kPaths[] = {
+        {"expr::eval budget", run_budget, 0, true, 1, false, false},
+        {"prog::try_eval", run_try_eval, 0, true, 1, false, false},
+        {"prog::run", run_prog, 0, true, 1, false, false},
+        {"prog::run_batch", run_batch<Accuracy::EXACT>, 0, true, 1, false,
+         false},
+        {"run_batch ulp1", run_batch<Accuracy::ULP1>, 1 + kUlpSlack, true, 1,
+         true, false},
+        {"run_batch ulp4", run_batch<Accuracy::ULP4>, 4 + kUlpSlack, true, 1,
+         true, false},
+        {"memo::run", run_memo, 0, true, 1, false, false},
+        {"image", run_image, 0, true, 8, false, false},
+        {"stream", run_stream, 0, false, 1, false, false},
+        {"par::try_eval", run_par, 0, true, 16, false, false},
+        {"exact::eval", run_exact, 0, true, 4, false, true},
+        {"cache::eval", run_cache, 0, true, 4, false, false},
+    };
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc > 3) {
+        std::fprintf(stderr, "Usage: %s [cases] [seed]\n", argv[0]);
+        return 2;
+    }
+    const uint64_t n_case = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                     : kCases;
+    const uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10)
+                                   : kSeed;
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<std::string> in;
+    std::vector<bool> kern;
+    std::vector<Outcome> want(kBlock), got(kBlock);
+    Tally ref;
+    Tally tally[std::size(kPaths)];
+    uint64_t n_valid = 0;
+    for (uint64_t b = 0, done = 0; done < n_case; ++b, done += in.size()) {
+        make_block(seed * 0x9e3779b97f4a7c15ull + b,
+                   std::min<uint64_t>(kBlock, n_case - done), in, kern);
+        auto t0 = Clock::now();
+        kRef.run(in, want);
+        ref.secs += std::chrono::duration<double>(Clock::now() - t0).count();
+        ref.n += in.size();
+        for (const auto &o : want)
+            n_valid += o.ok;
+
+        for (size_t k = 0; k < std::size(kPaths); ++k) {
+            const Path &p = kPaths[k];
+            Tally &t = tally[k];
+            if (b % p.every != 0)
+                continue;
+            t0 = Clock::now();
+            p.run(in, got);
+            t.secs += std::chrono::duration<double>(Clock::now() - t0).count();
+            t.n += in.size();
+            for (size_t i = 0; i < in.size(); ++i) {
+                if (p.kernel_only && !kern[i])
+                    continue;
+                if (!p.errors_only && want[i].ok && got[i].ok &&
+                    std::isfinite(want[i].value) &&
+                    std::isfinite(got[i].value))
+                    t.worst = std::max(
+                        t.worst, vmath::ulp_diff(want[i].value, got[i].value));
+                if (same(p, want[i], got[i]))
+                    continue;
+                if (t.n_bad++ == 0)
+                    t.first = in[i];
+            }
+        }
+    }
+
+    std::printf("%llu cases (seed %llu), %llu valid\n",
+                static_cast<unsigned long long>(n_case),
+                static_cast<unsigned long long>(seed),
+                static_cast<unsigned long long>(n_valid));
+    std::printf("  %-18s %9s %12s %10s %9s\n", "path", "ns/case", "cases/s",
+                "mismatch", "max ulp");
+    const auto row = [](const Path &p, const Tally &t) {
+        std::printf("  %-18s %9.1f %12.0f %10llu %9u\n", p.name,
+                    t.secs * 1e9 / t.n, t.n / t.secs,
+                    static_cast<unsigned long long>(t.n_bad), t.worst);
+    };
+    row(kRef, ref);
+    int rc = 0;
+    for (size_t k = 0; k < std::size(kPaths); ++k) {
+        row(kPaths[k], tally[k]);
+        rc |= tally[k].n_bad != 0;
+    }
+    for (size_t k = 0; k < std::size(kPaths); ++k) {
+        const Path &p = kPaths[k];
+        if (tally[k].n_bad == 0)
+            continue;
+        const std::string s = shrink(p, tally[k].first);
+        const std::vector<std::string> one = {s};
+        std::vector<Outcome> r(1), g(1);
+        run_ref(one, r);
+        p.run(one, g);
+        std::printf("%s: \"%s\"\n  expr::eval: %s\n  %s: %s\n", p.name,
+                    s.c_str(), describe(r[0]).c_str(), p.name,
+                    describe(g[0]).c_str());
+    }
+    return rc;
+}
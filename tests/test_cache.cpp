@@ -0,0 +1,165 @@
+#include "cache.hpp"
+#include "exam.hpp"
+#include "prog.hpp"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+TEST(CACHE, Normalize) {
+    EXPECT_EQ(cache::normalize("  2 +\t3  *   4\r"), "2 + 3 * 4");
+    EXPECT_EQ(cache::normalize("ln4!"), "ln4!");
+    EXPECT_EQ(cache::normalize(" \t "), "");
+    EXPECT_EQ(cache::key("2 + 3"), cache::key(cache::normalize(" 2  +   3")));
+    EXPECT_FALSE(cache::key("2 + 3") == cache::key("2 + 4"));
+    EXPECT_FALSE(cache::key("2") == cache::key("2 "));
+    EXPECT_FALSE(cache::key("12345678") == cache::key("12345678 "));
+
+    // the messages of the error codes are those of the errors
+    for (const char *str : {"2 + x", "2 $ 3", "((2)", "2 +", "2 3", "()"}) {
+        const auto r = prog::try_eval(str);
+        ASSERT_FALSE(r.has_value()) << str;
+        EXPECT_STREQ(expr::message(r.error().code), r.error().msg) << str;
+    }
+}
+
+TEST(CACHE, RoundTrip) {
+    const auto path =
+        std::filesystem::temp_directory_path() / "scicalc_test.cache";
+    std::filesystem::remove(path);
+    const exam::Generator g("+, -, *, /, ^, !, ln", 4, 2, 9);
+    std::mt19937 gen(39);
+    std::vector<std::string> exprs;
+    for (int i = 0; i < 3000; ++i)
+        exprs.push_back(g.Expr(gen));
+    exprs.push_back("2 + x");
+    exprs.push_back("(2 + 3");
+
+    auto expect_same = [&](cache::Store &store) {
+        for (const auto &s : exprs) {
+            const auto want = prog::try_eval(s.c_str());
+            const auto got = cache::eval(store, s);
+            ASSERT_EQ(got.has_value(), want.has_value()) << s;
+            if (!want) {
+                EXPECT_EQ(got.error().code, want.error().code) << s;
+                EXPECT_EQ(got.error().offset, want.error().offset) << s;
+            } else if (std::isnan(want.value())) {
+                EXPECT_TRUE(std::isnan(got.value())) << s;
+            } else {
+                EXPECT_EQ(got.value(), want.value()) << s;
+            }
+        }
+    };
+    {
+        cache::Store store(path);
+        expect_same(store);
+        EXPECT_EQ(store.Usage().inserts, store.Size());
+        EXPECT_EQ(store.Usage().hits, exprs.size() - store.Size());
+    }
+    const auto size = std::filesystem::file_size(path);
+    {
+        // every line is found, nothing is appended
+        cache::Store store(path);
+        expect_same(store);
+        EXPECT_EQ(store.Usage().hits, exprs.size());
+        EXPECT_EQ(store.Usage().inserts, 0u);
+    }
+    EXPECT_EQ(std::filesystem::file_size(path), size);
+
+    // a torn append is cut off, a foreign version starts over
+    {
+        std::ofstream ofs(path, std::ios::binary | std::ios::app);
+        ofs << "torn";
+    }
+    {
+        cache::Store store(path);
+        EXPECT_EQ(store.Bytes(), size);
+    }
+    EXPECT_EQ(std::filesystem::file_size(path), size);
+    {
+        std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+        fs.seekp(offsetof(cache::Header, version));
+        fs.put(static_cast<char>(cache::kVersion + 1));
+    }
+    {
+        cache::Store store(path);
+        EXPECT_EQ(store.Size(), 0u);
+        EXPECT_EQ(store.Bytes(), sizeof(cache::Header));
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(CACHE, SizeLimit) {
+    const auto path =
+        std::filesystem::temp_directory_path() / "scicalc_limit.cache";
+    std::filesystem::remove(path);
+    static constexpr size_t kLimit =
+        sizeof(cache::Header) + 100 * sizeof(cache::Record);
+    static constexpr size_t kHalf =
+        sizeof(cache::Header) + 50 * sizeof(cache::Record);
+    {
+        cache::Store store(path, kLimit);
+        for (int i = 0; i < 80; ++i)
+            cache::eval(store, std::to_string(i) + " + 1");
+    }
+    {
+        // 40 of the old keys are used again and 60 new ones are added: half
+        // the limit is kept, the used ones in file order, i.e. 40 to 89
+        cache::Store store(path, kLimit);
+        EXPECT_EQ(store.Size(), 80u);
+        for (int i = 40; i < 140; ++i)
+            cache::eval(store, std::to_string(i) + " + 1");
+        store.Flush();
+        EXPECT_EQ(store.Usage().compactions, 1u);
+        EXPECT_EQ(store.Size(), 50u);
+        EXPECT_EQ(store.Bytes(), kHalf);
+        EXPECT_EQ(cache::eval(store, "89 + 1").value(), 90.0f);
+        EXPECT_EQ(store.Usage().inserts, 60u);
+
+        // the next flush appends under the limit instead of compacting
+        for (int i = 140; i < 150; ++i)
+            cache::eval(store, std::to_string(i) + " + 1");
+        store.Flush();
+        EXPECT_EQ(store.Usage().compactions, 1u);
+        EXPECT_EQ(store.Bytes(), kHalf + 10 * sizeof(cache::Record));
+    }
+    EXPECT_EQ(std::filesystem::file_size(path),
+              kHalf + 10 * sizeof(cache::Record));
+    {
+        cache::Store store(path, kLimit);
+        cache::eval(store, "0 + 1");
+        EXPECT_EQ(store.Usage().hits, 0u);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(CACHE, Run) {
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto src = dir / "scicalc_batch.txt";
+    const auto path = dir / "scicalc_batch.cache";
+    std::filesystem::remove(path);
+    {
+        std::ofstream ofs(src);
+        ofs << "# comment\n3! - ln(5-1)\n\n  2  +  x\n(2 + 3) * 4\n7 / 2";
+    }
+    const std::string want = "3! - ln(5-1) = 4.61371\n"
+                             "2 + x : Unknown function at column 5\n"
+                             "(2 + 3) * 4 = 20\n"
+                             "7 / 2 = 3.5\n";
+    std::ostringstream plain;
+    cache::run(src, nullptr, plain);
+    EXPECT_EQ(plain.str(), want);
+    for (int pass = 0; pass < 2; ++pass) {
+        cache::Store store(path);
+        std::ostringstream out;
+        cache::run(src, &store, out);
+        EXPECT_EQ(out.str(), want);
+        EXPECT_EQ(store.Usage().hits, pass == 0 ? 0u : 4u);
+    }
+    std::filesystem::remove(src);
+    std::filesystem::remove(path);
+}
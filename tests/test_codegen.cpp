@@ -0,0 +1,73 @@
+#include "codegen.hpp"
+#include "formulas.hpp" // generated from formulas.txt
+#include "vmath.hpp"
+#include <bit>
+#include <gtest/gtest.h>
+#include <initializer_list>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+    // `prog::run` of a parsed formula with its variables bound to `args`
+    float run_formula(const char *line, std::initializer_list<float> args) {
+        codegen::Formula f = codegen::parse(line);
+        for (auto &v : f.prog.pool) {
+            const auto bits = std::bit_cast<uint32_t>(v);
+            for (size_t i = 0; i < args.size(); ++i)
+                if (bits == codegen::param_bits(i))
+                    v = args.begin()[i];
+        }
+        return prog::run(f.prog.view());
+    }
+
+} // namespace
+
+TEST(CODEGEN, MatchesRun) {
+    // the compiler folds constant libm calls with correct rounding
+    EXPECT_LE(vmath::ulp_diff(formulas::quiz(),
+                              run_formula("quiz = 3! - ln(5-1) + 3^2 / 7", {})),
+              1u);
+    for (const float x : {0.5f, 1.0f, 2.0f, 3.0f, 7.25f, -1.5f}) {
+        EXPECT_EQ(formulas::area(x), run_formula("area(r) = pi * r^2", {x}));
+        EXPECT_EQ(formulas::ratio(x),
+                  run_formula("ratio(n) = n! / (n - 1)!", {x}));
+        EXPECT_EQ(formulas::nested(x),
+                  run_formula("nested(x) = ((x + 1) * (x - 1))^2 / x", {x}));
+        EXPECT_EQ(formulas::unused(x, 2), x + 1);
+        EXPECT_EQ(formulas::wave(x, 0, 3),
+                  run_formula("wave(x, lo, hi) = min(max(x, lo), hi) + "
+                              "sqrt(abs x) * sin x",
+                              {x, 0, 3}));
+        for (const float y : {0.25f, 3.0f, -2.0f}) {
+            EXPECT_EQ(
+                formulas::poly(x, y),
+                run_formula("poly(x, y) = -x^3 + 2*x*y - y / (x + 1)", {x, y}));
+            const float want =
+                run_formula("logs(a, b) = ln a - ln(b * e)", {x, y});
+            if (std::isnan(want))
+                EXPECT_TRUE(std::isnan(formulas::logs(x, y)));
+            else
+                EXPECT_EQ(formulas::logs(x, y), want);
+        }
+    }
+}
+
+TEST(CODEGEN, Errors) {
+    for (const char *bad : {"f(x) = y", "f(x) = x +", "1f(x) = x",
+                            "f(x, x) = x", "f(ln) = 1", "f(x, ) = x",
+                            "int(x) = x", "f(for) = 1", "f(x = x", "f x"}) {
+        EXPECT_THROW(codegen::parse(bad), std::runtime_error) << bad;
+    }
+    EXPECT_EQ(codegen::parse("f() = 1").params.size(), 0u);
+
+    std::istringstream dup("# two of a kind\nf(x) = x\n\nf(y) = y\n");
+    try {
+        codegen::read(dup);
+        FAIL() << "duplicate formula accepted";
+    } catch (const std::runtime_error &ex) {
+        EXPECT_EQ(std::string(ex.what()), "Line 4: Duplicate formula: `f`");
+    }
+}
@@ -0,0 +1,104 @@
+#include "exact.hpp"
+#include "script.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+
+TEST(EXACT, Integer) {
+    struct Case {
+        const char *str;
+        int64_t val;
+    };
+    const Case cases[] = {
+        {"13!", 6227020800},
+        {"20!", 2432902008176640000},
+        {"7^9", 40353607},
+        {"2^62 - 1 + 2^62", 9223372036854775807},
+        {"(3 - 5)^3", -8},
+        {"1^1000000 + (0-1)^1001", 0},
+        {"3!! / 4!", 30},
+        {"ln 1 + ln(1)", 0},
+        {"4 / 6 * 3", 2},
+    };
+    for (const auto &c : cases) {
+        const auto v = exact::eval(c.str);
+        EXPECT_TRUE(v.IsInt()) << c.str;
+        EXPECT_EQ(v.num, c.val) << c.str;
+    }
+}
+
+TEST(EXACT, Rational) {
+    const auto v = exact::eval("7 / 3 - 1 / 6");
+    EXPECT_EQ(v.num, 13);
+    EXPECT_EQ(v.den, 6);
+    EXPECT_EQ(v.ToStr(), "13/6");
+    EXPECT_EQ(exact::eval("(2 / 3)^(0-2)").ToStr(), "9/4");
+    EXPECT_EQ(exact::eval("0 - 4 / 6").ToStr(), "-2/3");
+    EXPECT_EQ(exact::eval("max(1 / 3, 2 / 7) + abs(0 - 1 / 2)").ToStr(),
+              "5/6");
+    EXPECT_EQ(exact::eval("min(2^62, 20!) * 2 - cos 0").ToStr(),
+              "4865804016353279999");
+}
+
+TEST(EXACT, Fallback) {
+    // not rational or past int64: same as the float evaluation
+    const char *strs[] = {"21!", "2^63", "2^64 / 2", "ln 2", "pi * 2",
+                          "1 / 0", "0 - 1 / 0", "ln(0 - 1)",
+                          "sin 1", "sqrt 2"};
+    for (const char *s : strs) {
+        const auto v = exact::eval(s);
+        EXPECT_FALSE(v.IsExact()) << s;
+        const float want = prog::eval(s);
+        if (std::isnan(want))
+            EXPECT_TRUE(std::isnan(v.ToFloat())) << s;
+        else
+            EXPECT_EQ(v.ToFloat(), want) << s;
+    }
+    EXPECT_EQ(exact::eval("2^62 * 2 - 1").ToFloat(), 0x1p63f);
+}
+
+TEST(EXACT, Literal) {
+    // past 2^24 a float pool would round the operands
+    EXPECT_EQ(exact::eval("16777217 - 16777216").ToStr(), "1");
+    EXPECT_EQ(exact::eval("9007199254740993 * 3").ToStr(), "27021597764222979");
+    EXPECT_EQ(exact::eval("9223372036854775807 - 1").ToStr(),
+              "9223372036854775806");
+    EXPECT_EQ(exact::eval("123456789 / 987654321").ToStr(),
+              "13717421/109739369");
+    // not an integer: the float
+    EXPECT_EQ(exact::eval("2.5 * 2").ToFloat(), prog::eval("2.5 * 2"));
+    EXPECT_THROW(exact::eval("1 +"), std::runtime_error);
+    const auto bad = exact::try_eval("2 * x");
+    ASSERT_FALSE(bad.has_value());
+    EXPECT_EQ(bad.error().code, expr::Errc::UNKNOWN_FN);
+}
+
+TEST(EXACT, Env) {
+    exact::Env vars;
+    EXPECT_EQ(vars.Find("x"), nullptr);
+    ASSERT_TRUE(vars.Set("x", exact::eval("2^40 + 1")));
+    ASSERT_TRUE(vars.Set("y", exact::eval("1 / 3")));
+    EXPECT_FALSE(vars.Set("pi", exact::Value::Int(3)));
+    EXPECT_EQ(exact::eval("x - 2^40 + y", &vars).ToStr(), "4/3");
+    EXPECT_EQ(*vars.Floats().Find("x"), 0x1p40f);
+    ASSERT_TRUE(vars.Set("x", exact::Value::Int(16777217)));
+    EXPECT_EQ(vars.Size(), 2u);
+    EXPECT_EQ(vars.At(0).num, 16777217);
+    EXPECT_EQ(exact::eval("x - 16777216", &vars).ToStr(), "1");
+
+    // assignments keep the exact value, whichever the mode
+    auto r = script::exec("z = 16777217 * 2", vars, true);
+    ASSERT_TRUE(r.has_value());
+    EXPECT_EQ(r.value().kind, script::Kind::ASSIGN);
+    EXPECT_EQ(r.value().value.num, 33554434);
+    r = script::exec("z - 33554433", vars, true);
+    ASSERT_TRUE(r.has_value());
+    EXPECT_EQ(r.value().kind, script::Kind::EXPR);
+    EXPECT_EQ(r.value().value.ToStr(), "1");
+    r = script::exec("w = 2 / 3", vars, false);
+    ASSERT_TRUE(r.has_value());
+    EXPECT_FALSE(r.value().value.IsExact());
+    EXPECT_EQ(vars.Find("w")->ToFloat(), prog::eval("2 / 3"));
+    r = script::exec("v = z +", vars, true);
+    ASSERT_FALSE(r.has_value());
+    EXPECT_EQ(vars.Find("v"), nullptr);
+}
@@ -0,0 +1,104 @@
+#include "exam.hpp"
+#include "prog.hpp"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TEST(EXAM, GeneratorSeeded) {
+    const exam::Generator g("+, -, *, /, ^, !, ln", 4, 2, 9);
+    std::mt19937 gen1(7), gen2(7);
+    for (int i = 0; i < 100; ++i) {
+        const auto q1 = g.Draw(gen1);
+        const auto q2 = g.Draw(gen2);
+        EXPECT_EQ(q1.expr, q2.expr);
+        EXPECT_TRUE(std::isfinite(q1.ans)) << q1.expr;
+        EXPECT_EQ(q1.ans, prog::eval(q1.expr.c_str()));
+    }
+}
+
+TEST(EXAM, Session) {
+    const exam::Generator g("+, -, *, /, ^, !, ln", 4, 2, 9);
+    std::vector<std::string> first;
+    for (const size_t depth : {size_t(1), exam::kSessionDepth}) {
+        exam::Session s(g, 200, 40, depth);
+        ASSERT_EQ(s.Size(), 200u);
+        for (size_t i = 0; i < s.Size(); ++i) {
+            const auto q = s.Next();
+            EXPECT_TRUE(std::isfinite(q.ans)) << q.expr;
+            EXPECT_EQ(q.ans, prog::eval(q.expr.c_str()));
+            // the queue depth does not change the quizzes
+            if (depth == 1)
+                first.push_back(q.expr);
+            else
+                EXPECT_EQ(q.expr, first[i]);
+        }
+        EXPECT_THROW(s.Next(), std::out_of_range);
+    }
+
+    // the first quiz does not wait for the others, and a session left
+    // early stops drawing
+    {
+        exam::Session s(g, size_t(1) << 40, 40);
+        EXPECT_EQ(s.Next().expr, first[0]);
+    }
+
+    // every answer overflows
+    exam::Session s(exam::Generator("^", 3, 90, 99), 10, 40);
+    EXPECT_THROW(s.Next(), std::runtime_error);
+}
+
+TEST(EXAM, GenerateGrade) {
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto sheet = dir / "scicalc_test.sheet";
+    const auto ans = dir / "scicalc_test.ans";
+    const auto out = dir / "scicalc_test.scores";
+
+    const exam::Generator g("+, -, *", 3, 2, 9);
+    const auto st = exam::generate(sheet, g, 8, 5, 42);
+    EXPECT_EQ(st.n_quiz, 40u);
+
+    const exam::Sheet sh(sheet);
+    ASSERT_EQ(sh.NExam(), 8u);
+    ASSERT_EQ(sh.NQuiz(), 5u);
+    {
+        // student `a` answers exam 3 correctly except the last quiz
+        std::ofstream ofs(ans);
+        ofs << "a 3";
+        for (uint32_t i = 0; i < 4; ++i)
+            ofs << ' ' << prog::eval(std::string(sh.Expr(15 + i)).c_str());
+        ofs << " 1e9\nb 8 1 2 3\n";
+    }
+    exam::grade(sheet, ans, out);
+
+    std::ifstream ifs(out);
+    std::string line;
+    std::getline(ifs, line);
+    EXPECT_EQ(line, "a 4 5");
+    std::getline(ifs, line);
+    EXPECT_EQ(line, "b invalid");
+
+    // offsets that go backwards, or a header whose sizes overflow
+    const auto patch = [&](const size_t at, const uint64_t v) {
+        exam::generate(sheet, g, 8, 5, 42);
+        std::fstream fs(sheet, std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(static_cast<std::streamoff>(at));
+        fs.write(reinterpret_cast<const char *>(&v), sizeof(v));
+    };
+    const size_t off_offsets = (sizeof(exam::SheetHeader) + 40 * 4 + 7) & ~7;
+    patch(off_offsets + 8 * 10, uint64_t(1) << 40);
+    EXPECT_THROW(exam::Sheet{sheet}, std::runtime_error);
+    patch(offsetof(exam::SheetHeader, n_exam), UINT64_MAX);
+    EXPECT_THROW(exam::Sheet{sheet}, std::runtime_error);
+
+    // every answer overflows
+    EXPECT_THROW(exam::generate(sheet, exam::Generator("^", 3, 90, 99), 2, 2,
+                                42),
+                 std::runtime_error);
+
+    for (const auto &p : {sheet, ans, out})
+        std::filesystem::remove(p);
+}
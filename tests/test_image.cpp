@@ -0,0 +1,99 @@
+#include "image.hpp"
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+
+TEST(PROG, MatchReference) {
+    const char *strs[] = {
+        "2 + 3 - 4 * 5 - 6^2",
+        "(8 - 7 - (3 - 1)) * 3 - 2^(3+1)",
+        "4*5+2^(3-1)^2 - 6*(7 + 1)/4 - 9",
+        "ln4!",
+        "3! - ln(5-1) + 7 / 3^2",
+        "-2^2 + 3!!",
+        "2 * ln 4 ^ 2",
+    };
+    for (const char *s : strs)
+        EXPECT_EQ(expr::eval(s), prog::eval(s)) << s;
+
+    EXPECT_THROW(prog::eval("2 +"), std::runtime_error);
+    EXPECT_THROW(prog::eval("! 3"), std::runtime_error);
+    EXPECT_THROW(prog::eval("()"), std::runtime_error);
+}
+
+TEST(PROG, TryEval) {
+    const auto ok = prog::try_eval("3! - ln(5-1) + 7 / 3^2");
+    ASSERT_TRUE(ok.has_value());
+    EXPECT_EQ(ok.value(), expr::eval("3! - ln(5-1) + 7 / 3^2"));
+
+    struct Case {
+        const char *str;
+        expr::Errc code;
+        uint32_t offset;
+    };
+    const Case cases[] = {
+        {"   ", expr::Errc::EMPTY_STRING, 0},
+        {"2 + x", expr::Errc::UNKNOWN_FN, 4},
+        {"2 $ 3", expr::Errc::UNKNOWN_OP, 2},
+        {"(2 + 3))", expr::Errc::UNMATCHED_RPAR, 7},
+        {"((2 + 3)", expr::Errc::UNMATCHED_LPAR, 8},
+        {"2 +", expr::Errc::UNFINISHED_EXPR, 2},
+        {"* 2", expr::Errc::INCOMPLETE_EXPR, 0},
+        {"2 3", expr::Errc::DANGLING_NUM_OPL, 0},
+        {"2 * * 3", expr::Errc::DANGLING_OPR_OPI, 2},
+    };
+    for (const auto &c : cases) {
+        const auto r = prog::try_eval(c.str);
+        ASSERT_FALSE(r.has_value()) << c.str;
+        EXPECT_EQ(r.error().code, c.code) << c.str;
+        EXPECT_EQ(r.error().offset, c.offset) << c.str;
+        EXPECT_THROW(expr::eval(c.str), std::runtime_error) << c.str;
+    }
+}
+
+TEST(IMAGE, RoundTrip) {
+    const auto path =
+        std::filesystem::temp_directory_path() / "scicalc_test.img";
+    const std::vector<std::string> srcs = {"3! - ln(5-1) + 3^2 / 7",
+                                           "2 * (3 + 4) * 5 - 6 * 7", "pi"};
+    image::write(path, srcs);
+
+    const image::Image img(path);
+    ASSERT_EQ(img.Size(), srcs.size());
+    for (uint32_t i = 0; i < img.Size(); ++i) {
+        EXPECT_EQ(img.Source(i), srcs[i]);
+        EXPECT_EQ(img.Eval(i), expr::eval(srcs[i].c_str()));
+    }
+
+    // flip the last byte of the string table
+    {
+        std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(-1, std::ios::end);
+        fs.put('x');
+    }
+    EXPECT_THROW(image::Image{path}, std::runtime_error);
+    EXPECT_NO_THROW(image::Image(path, false));
+
+    // a bad operator, pool index or depth is rejected even unverified
+    const auto corrupt = [&](const size_t section, const size_t at,
+                             const uint32_t v) {
+        image::write(path, srcs);
+        std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+        image::Header hdr;
+        fs.read(reinterpret_cast<char *>(&hdr), sizeof(hdr));
+        const uint64_t offs[] = {hdr.off_expr, hdr.off_code};
+        fs.seekp(static_cast<std::streamoff>(offs[section] + at));
+        fs.write(reinterpret_cast<const char *>(&v), sizeof(v));
+    };
+    corrupt(1, offsetof(prog::Instr, op), 200);
+    EXPECT_THROW(image::Image(path, false), std::runtime_error);
+    corrupt(1, offsetof(prog::Instr, arg), 1000);
+    EXPECT_THROW(image::Image(path, false), std::runtime_error);
+    corrupt(0, offsetof(image::Entry, depth), 1);
+    EXPECT_THROW(image::Image(path, false), std::runtime_error);
+    corrupt(0, offsetof(image::Entry, depth), 1000);
+    EXPECT_THROW(image::Image(path, false), std::runtime_error);
+    corrupt(0, 0, 0); // unchanged
+    EXPECT_NO_THROW(image::Image(path, false));
+    std::filesystem::remove(path);
+}
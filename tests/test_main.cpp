@@ -1,4 +1,16 @@
+#include "test_cache.cpp"
+#include "test_codegen.cpp"
+#include "test_exact.cpp"
+#include "test_exam.cpp"
+#include "test_image.cpp"
+#include "test_memo.cpp"
+#include "test_par.cpp"
 #include "test_parser.cpp"
+#include "test_pool.cpp"
+#include "test_script.cpp"
+#include "test_shm.cpp"
+#include "test_stream.cpp"
+#include "test_vmath.cpp"
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
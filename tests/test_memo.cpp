@@ -0,0 +1,60 @@
+#include "exam.hpp"
+#include "memo.hpp"
+#include "prog.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(MEMO, MatchesRun) {
+    const exam::Generator g("+, -, *, /, ^, !, ln", 4, 2, 5);
+    std::mt19937 gen(34);
+    std::vector<prog::Program> progs;
+    for (int i = 0; i < 2000; ++i)
+        progs.push_back(prog::compile(g.Expr(gen).c_str()));
+
+    // a tiny table evicts all the time, which must not change the values
+    for (const size_t slots : {size_t(4), memo::kSlots}) {
+        memo::Table t(slots);
+        for (const auto &p : progs) {
+            const float want = prog::run(p.view());
+            const float got = memo::run(p.view(), t);
+            if (std::isnan(want))
+                EXPECT_TRUE(std::isnan(got));
+            else
+                EXPECT_EQ(got, want);
+        }
+        EXPECT_GT(t.Usage().hits, 0u);
+    }
+}
+
+TEST(MEMO, Stats) {
+    std::vector<prog::Program> progs;
+    for (const char *str : {"ln(4) + 1", "2 * ln(4)", "ln(4)", "ln(5) - 3!",
+                            "1 + 2", "(3! - ln 5) * 2", "(3 + 5)!", "8!"})
+        progs.push_back(prog::compile(str));
+    std::vector<prog::View> views;
+    for (const auto &p : progs)
+        views.push_back(p.view());
+
+    EXPECT_EQ(memo::Table(5).Slots(), 8u); // rounded up
+    memo::Table t;
+    std::vector<float> out(views.size());
+    memo::run_batch(views, out.data(), t);
+    for (size_t i = 0; i < views.size(); ++i)
+        EXPECT_EQ(out[i], prog::run(views[i]));
+
+    // `ln(4)` twice, `3!` and `ln 5` once each, and `8!` whatever its
+    // operand was spelled as; `+ - * /` are not looked up
+    const memo::Stats &st = t.Usage();
+    EXPECT_EQ(st.lookups, 9u);
+    EXPECT_EQ(st.hits, 5u);
+    EXPECT_EQ(st.inserts, 4u);
+    EXPECT_NEAR(st.HitRate(), 5.0 / 9, 1e-9);
+
+    t.Clear();
+    EXPECT_EQ(t.Usage().lookups, 0u);
+    memo::run(views[2], t);
+    EXPECT_EQ(t.Usage().hits, 0u);
+}
@@ -0,0 +1,80 @@
+#include "exam.hpp"
+#include "par.hpp"
+#include "pool.hpp"
+#include "prog.hpp"
+#include <cmath>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(PAR, Split) {
+    using Cuts = std::vector<uint32_t>;
+    EXPECT_EQ(par::split("1 + 2 * 3 - 4"), (Cuts{2, 10}));
+    EXPECT_EQ(par::split("-1 + ln 2 * 3!"), (Cuts{3}));
+    EXPECT_EQ(par::split("(1 + 2) * (3 - 4) / pi"), (Cuts{8, 18}));
+    EXPECT_TRUE(par::split("42").empty());
+    EXPECT_TRUE(par::split("(1 + 2 - 3)").empty());
+    EXPECT_TRUE(par::split("-2 * 3").empty());
+    EXPECT_TRUE(par::split("(1 + 2)!").empty());
+    EXPECT_TRUE(par::split("2^3^2").empty());
+    EXPECT_TRUE(par::split("1 + (2").empty());
+}
+
+TEST(PAR, MatchesSerial) {
+    pool::Pool p(4);
+    par::Options opt;
+    opt.threshold = 0;
+    opt.pool = &p;
+
+    // long chains of quizzes joined at the top level
+    const exam::Generator g("+, -, *, /, ^, !, ln", 3, 2, 9);
+    std::mt19937 gen(32);
+    for (const char *ops : {"+-", "*/", "+-*/^"}) {
+        std::uniform_int_distribution<size_t> pick(0, std::strlen(ops) - 1);
+        std::string str = "(";
+        str += g.Draw(gen).expr;
+        str += ')';
+        for (int i = 0; i < 2000; ++i) {
+            str += ' ';
+            str += ops[pick(gen)];
+            str += " (" + g.Draw(gen).expr + ")";
+        }
+        const float want = prog::eval(str.c_str());
+        const float got = par::eval(str.c_str(), opt);
+        if (std::isnan(want))
+            EXPECT_TRUE(std::isnan(got)) << ops;
+        else
+            EXPECT_EQ(got, want) << ops;
+    }
+
+    // errors in one operand are those of the serial path
+    for (const char *bad : {"1 + (2 - 3", "1 + 2 * -3", "1 + x - 2"}) {
+        const auto want = prog::try_eval(bad);
+        const auto got = par::try_eval(bad, opt);
+        ASSERT_FALSE(got) << bad;
+        EXPECT_EQ(got.error().code, want.error().code) << bad;
+        EXPECT_EQ(got.error().offset, want.error().offset) << bad;
+    }
+}
+
+TEST(PAR, Reassociate) {
+    pool::Pool p(4);
+    par::Options opt;
+    opt.threshold = 0;
+    opt.pool = &p;
+    opt.reassociate = true;
+
+    std::string str = "1";
+    for (int i = 2; i <= 10000; ++i)
+        str += (i % 3 == 0 ? " - " : " + ") + std::to_string(i % 7);
+    const float want = prog::eval(str.c_str());
+    EXPECT_NEAR(par::eval(str.c_str(), opt), want, std::fabs(want) * 1e-5f);
+
+    // not a `+ -` or `*` chain, folded in order
+    str = "1";
+    for (int i = 2; i <= 1000; ++i)
+        str += (i % 2 == 0 ? " * " : " / ") + std::to_string(i % 5 + 1);
+    EXPECT_EQ(par::eval(str.c_str(), opt), prog::eval(str.c_str()));
+}
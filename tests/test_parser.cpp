@@ -1,5 +1,10 @@
 #include "expr.hpp"
+#include "prog.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <gtest/gtest.h>
+#include <string>
 
 TEST(EXPR, ParseRaw) {
     char str1[] = "2 + 3 - 4 * 5 - 6^2";
@@ -28,3 +33,147 @@ TEST(EXPR, ParseRaw) {
     EXPECT_NEAR(ans6, expr::eval(str6), ep);
     EXPECT_NEAR(ans7, expr::eval(str7), ep);
 }
+
+TEST(EXPR, NanOperands) {
+    // NaN mid-chain used to read as a missing operand and never reduce; the
+    // step limit turns such a regression into a failure instead of a hang
+    expr::Budget b;
+    b.max_steps = 100;
+    for (const char *str : {"ln 0 - 1", "0/0 + 1", "2 * ln(0) ^ 2 - 3!",
+                            "(0 - 1)! + ln(0 - 2)"})
+        EXPECT_TRUE(std::isnan(expr::eval(str, b))) << str;
+    EXPECT_EQ(expr::eval("ln 1 - 1", b), -1);
+}
+
+TEST(EXPR, Functions) {
+    struct Case {
+        const char *str;
+        float want;
+    };
+    const Case cases[] = {
+        {"sin(0) + cos 0", 1},
+        {"sqrt 16 + abs(0 - 3)", 7},
+        {"exp 1", std::exp(1.0f)},
+        {"e", 2.71828182845904523536f},
+        {"2 * min(3, 4 + 5)", 6},
+        {"max(1, 2 * 3, 4) ^ 2", 36},
+        {"min(max(1, 2), 3 - max(0, 1))", 2},
+        {"-max(1, 2)", -2},
+    };
+    for (const auto &c : cases) {
+        EXPECT_EQ(expr::eval(c.str), c.want) << c.str;
+        const auto r = prog::try_eval(c.str);
+        ASSERT_TRUE(r.has_value()) << c.str;
+        EXPECT_EQ(r.value(), c.want) << c.str;
+    }
+    EXPECT_TRUE(std::isnan(prog::eval("max(0 - 1, ln 0)")));
+    EXPECT_TRUE(std::isnan(prog::eval("min(ln 0, 1)")));
+
+    // identifiers match exactly; a call needs its `(`, a `,` its call
+    struct Err {
+        const char *str;
+        expr::Errc code;
+        uint32_t offset;
+    };
+    const Err errs[] = {
+        {"lnx", expr::Errc::UNKNOWN_FN, 0},
+        {"2 * sinh 1", expr::Errc::UNKNOWN_FN, 4},
+        {"min 1, 2", expr::Errc::BAD_CALL, 4},
+        {"1 + max", expr::Errc::BAD_CALL, 7},
+        {"(1, 2)", expr::Errc::BAD_CALL, 2},
+        {"min((1, 2))", expr::Errc::BAD_CALL, 6},
+        {"min(1, 2) , 3", expr::Errc::BAD_CALL, 10},
+        {"2 + max(5)", expr::Errc::BAD_CALL, 9},
+        {"min((1), (2, 3))", expr::Errc::BAD_CALL, 11},
+        {"min(1, 2 $", expr::Errc::UNKNOWN_OP, 9},
+    };
+    for (const auto &e : errs) {
+        const auto r = prog::try_eval(e.str);
+        ASSERT_FALSE(r.has_value()) << e.str;
+        EXPECT_EQ(r.error().code, e.code) << e.str;
+        EXPECT_EQ(r.error().offset, e.offset) << e.str;
+        EXPECT_THROW(expr::eval(e.str), std::runtime_error) << e.str;
+    }
+}
+
+TEST(EXPR, Budget) {
+    const std::string deep = std::string(30, '(') + "1" + std::string(30, ')');
+    std::string wide = "1";
+    for (int i = 0; i < 5000; ++i)
+        wide += " + 1";
+
+    struct Case {
+        expr::Budget b;
+        const std::string &str;
+        expr::Errc code;
+    };
+    expr::Budget len, tokens, depth, steps;
+    len.max_len = 1000;
+    tokens.max_tokens = 1000;
+    depth.max_depth = 24;
+    steps.max_steps = 4999;
+    const Case cases[] = {
+        {len, wide, expr::Errc::TOO_LONG},
+        {tokens, wide, expr::Errc::TOO_MANY_TOKENS},
+        {depth, deep, expr::Errc::TOO_DEEP},
+        {steps, wide, expr::Errc::TOO_MANY_STEPS},
+    };
+    for (const auto &c : cases) {
+        const auto r = prog::try_eval(c.str.c_str(), nullptr, &c.b);
+        ASSERT_FALSE(r.has_value());
+        EXPECT_EQ(r.error().code, c.code);
+        EXPECT_THROW(expr::eval(c.str.c_str(), c.b), std::runtime_error);
+    }
+    steps.max_steps = 5000;
+    EXPECT_EQ(prog::try_eval(wide.c_str(), nullptr, &steps).value(), 5001);
+    EXPECT_EQ(expr::eval(wide.c_str(), steps), 5001);
+
+    std::atomic<bool> cancel{true};
+    expr::Budget b;
+    b.cancel = &cancel;
+    auto r = prog::try_eval(wide.c_str(), nullptr, &b);
+    ASSERT_FALSE(r.has_value());
+    EXPECT_EQ(r.error().code, expr::Errc::CANCELLED);
+    EXPECT_THROW(expr::eval("1 + 2", b), std::runtime_error);
+
+    b.cancel = nullptr;
+    b.deadline = expr::Budget::Clock::now();
+    r = prog::try_eval(wide.c_str(), nullptr, &b);
+    ASSERT_FALSE(r.has_value());
+    EXPECT_EQ(r.error().code, expr::Errc::TIMED_OUT);
+}
+
+TEST(EXPR, BudgetLargeInput) {
+    // a few MB of tokens would overflow the stack of the recursive chain
+    std::string huge = "1";
+    while (huge.size() < (size_t(2) << 20))
+        huge += "+1";
+    expr::Budget b;
+    b.max_len = size_t(4) << 20;
+    try {
+        expr::eval(huge.c_str(), b);
+        FAIL() << "no error";
+    } catch (const std::runtime_error &e) {
+        EXPECT_STREQ(e.what(), expr::message(expr::Errc::TOO_MANY_TOKENS));
+    }
+    EXPECT_EQ(prog::try_eval(huge.c_str(), nullptr, &b).value(),
+              static_cast<float>(huge.size() / 2 + 1));
+}
+
+TEST(EXPR, BudgetDeadlineLongChain) {
+    // right-associative: every reduction walks the whole chain
+    std::string pow = "1";
+    for (int i = 0; i < 4000; ++i)
+        pow += "^1";
+    using Clock = expr::Budget::Clock;
+    expr::Budget b;
+    const auto start = Clock::now();
+    b.deadline = start + std::chrono::milliseconds(10);
+    try {
+        expr::eval(pow.c_str(), b);
+        FAIL() << "no error";
+    } catch (const std::runtime_error &e) {
+        EXPECT_STREQ(e.what(), expr::message(expr::Errc::TIMED_OUT));
+    }
+    EXPECT_LT(Clock::now() - start, std::chrono::milliseconds(500));
+}
@@ -0,0 +1,21 @@
+#include "pool.hpp"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(POOL, ForCoversRange) {
+    pool::Pool p(4);
+    EXPECT_EQ(p.Size(), 4u);
+    for (const size_t n : {0, 1, 7, 1000, 100003}) {
+        std::vector<int> hits(n, 0);
+        std::atomic<size_t> n_chunks{0};
+        p.For(n, 64, [&](size_t begin, size_t end) {
+            ++n_chunks;
+            for (size_t i = begin; i < end; ++i)
+                ++hits[i];
+        });
+        for (size_t i = 0; i < n; ++i)
+            ASSERT_EQ(hits[i], 1) << i;
+        EXPECT_EQ(n_chunks.load(), n == 0 ? 0 : (n + 63) / 64);
+    }
+}
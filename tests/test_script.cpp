@@ -0,0 +1,70 @@
+#include "prog.hpp"
+#include "script.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+
+TEST(ENV, Table) {
+    env::Env vars;
+    EXPECT_EQ(vars.Find("x"), nullptr);
+    auto name_of = [](int i) {
+        std::string name = "v";
+        for (; i > 0; i /= 26)
+            name += static_cast<char>('a' + i % 26);
+        return name;
+    };
+    // enough names to grow the index a few times
+    for (int i = 0; i < 100; ++i)
+        ASSERT_TRUE(vars.Set(name_of(i), static_cast<float>(i))) << i;
+    EXPECT_EQ(vars.Size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_NE(vars.Find(name_of(i)), nullptr) << i;
+        EXPECT_EQ(*vars.Find(name_of(i)), static_cast<float>(i));
+    }
+    EXPECT_TRUE(vars.Set(name_of(53), -1));
+    EXPECT_EQ(*vars.Find(name_of(53)), -1.0f);
+    EXPECT_EQ(vars.Size(), 100u);
+
+    // builtins match exactly
+    for (const char *s : {"pi", "e", "ln", "exp", "min", "x1", ""})
+        EXPECT_FALSE(vars.Set(s, 1)) << s;
+    for (const char *s : {"lnx", "pie", "sinh"})
+        EXPECT_TRUE(vars.Set(s, 1)) << s;
+}
+
+TEST(SCRIPT, Assign) {
+    env::Env vars;
+    auto r = script::exec("x = 3! - ln(5)", vars);
+    ASSERT_TRUE(r.has_value());
+    EXPECT_EQ(r.value().kind, script::Kind::ASSIGN);
+    EXPECT_EQ(r.value().name, "x");
+    EXPECT_EQ(r.value().value, prog::eval("3! - ln(5)"));
+
+    r = script::exec("  y=x*2 + x", vars);
+    ASSERT_TRUE(r.has_value());
+    EXPECT_EQ(r.value().value, 3 * vars.Value(0));
+
+    r = script::exec("(x + y) / 2", vars);
+    ASSERT_TRUE(r.has_value());
+    EXPECT_EQ(r.value().kind, script::Kind::EXPR);
+    EXPECT_EQ(script::exec("# x = 1", vars).value().kind, script::Kind::NONE);
+
+    const auto bad = script::exec("pi = 3", vars);
+    ASSERT_FALSE(bad.has_value());
+    EXPECT_EQ(bad.error().code, expr::Errc::RESERVED_NAME);
+    const auto unbound = script::exec("z = x + w", vars);
+    ASSERT_FALSE(unbound.has_value());
+    EXPECT_EQ(unbound.error().code, expr::Errc::UNKNOWN_FN);
+    EXPECT_EQ(unbound.error().offset, 8u);
+    EXPECT_EQ(vars.Find("z"), nullptr);
+}
+
+TEST(SCRIPT, Run) {
+    env::Env vars;
+    std::istringstream in("# derivation\na = 2^3\n\nb = a! / a\na + b\n");
+    std::ostringstream out;
+    script::run(in, vars, out);
+    EXPECT_EQ(out.str(), "5048\n");
+
+    std::istringstream bad("a = 1\nb = (a\n");
+    EXPECT_THROW(script::run(bad, vars, out), std::runtime_error);
+}
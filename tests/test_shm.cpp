@@ -0,0 +1,71 @@
+#include "exam.hpp"
+#include "prog.hpp"
+#include "shm.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+TEST(SHM, MatchesTryEval) {
+    const exam::Generator g("+, -, *, /, ^, !, ln", 4, 2, 9);
+    std::mt19937 gen(36);
+    std::vector<std::string> exprs;
+    for (int i = 0; i < 3000; ++i)
+        exprs.push_back(g.Expr(gen));
+
+    const std::string name = "/scicalc_test_" + std::to_string(getpid());
+    for (const shm::Wait w : {shm::Wait::SPIN, shm::Wait::FUTEX}) {
+        // a small ring so that both sides find it full
+        shm::Channel server = shm::Channel::Create(name, 16);
+        uint64_t served = 0;
+        std::thread t([&] { served = server.Serve(w); });
+
+        shm::Channel client = shm::Channel::Open(name);
+        ASSERT_EQ(client.Slots(), 16u);
+        size_t next = 0;
+        shm::Response r;
+        for (size_t i = 0; i < exprs.size(); ++i) {
+            // keep at most `Slots()` in flight
+            for (; next < exprs.size() && next < i + 16; ++next)
+                client.Send(next, exprs[next], w);
+            client.Recv(r, w);
+            ASSERT_EQ(r.tag, i);
+            ASSERT_EQ(r.code, expr::Errc::OK) << exprs[i];
+            const float want = prog::try_eval(exprs[i].c_str()).value();
+            if (std::isnan(want))
+                EXPECT_TRUE(std::isnan(r.value)) << exprs[i];
+            else
+                EXPECT_EQ(r.value, want) << exprs[i];
+        }
+        client.Close();
+        t.join();
+        EXPECT_EQ(served, exprs.size());
+    }
+}
+
+TEST(SHM, Errors) {
+    const std::string name = "/scicalc_test_" + std::to_string(getpid());
+    shm::Channel server = shm::Channel::Create(name);
+    shm::Channel client = shm::Channel::Open(name);
+    for (const char *str : {"1 +", "2 $ 3", "(4", ""})
+        ASSERT_TRUE(client.TrySend(0, str));
+    EXPECT_THROW(client.TrySend(0, std::string(shm::kMaxText + 1, '1')),
+                 std::runtime_error);
+    // everything queued is answered before `Serve` sees the close
+    client.Close();
+    EXPECT_EQ(server.Serve(shm::Wait::FUTEX), 4u);
+
+    shm::Response r;
+    for (const auto code :
+         {expr::Errc::UNFINISHED_EXPR, expr::Errc::UNKNOWN_OP,
+          expr::Errc::UNMATCHED_LPAR, expr::Errc::EMPTY_STRING}) {
+        ASSERT_TRUE(client.TryRecv(r));
+        EXPECT_EQ(r.code, code);
+    }
+    EXPECT_FALSE(client.TryRecv(r));
+    EXPECT_THROW(shm::Channel::Open(name + "_missing"), std::runtime_error);
+}
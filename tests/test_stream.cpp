@@ -0,0 +1,104 @@
+#include "env.hpp"
+#include "exam.hpp"
+#include "prog.hpp"
+#include "stream.hpp"
+#include <cmath>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+
+TEST(STREAM, MatchesSerial) {
+    const exam::Generator g("+, -, *, /, ^, !, ln", 6, 2, 9);
+    std::mt19937 gen(33);
+    std::vector<std::string> strs{"3! - ln(5-1) + 3^2 / 7", "-(2 + 3) * pi",
+                                  "e ^ 2 - 12.5", "+ln ln 20"};
+    for (int i = 0; i < 200; ++i)
+        strs.push_back(g.Draw(gen).expr);
+
+    for (const auto &str : strs) {
+        const float want = prog::try_eval(str.c_str()).value();
+        // tokens split at every possible position
+        for (const size_t chunk : {size_t(1), size_t(3), stream::kChunk}) {
+            std::istringstream in(str);
+            const auto got = stream::try_eval(in, nullptr, chunk);
+            ASSERT_TRUE(got) << str;
+            if (std::isnan(want))
+                EXPECT_TRUE(std::isnan(got.value())) << str;
+            else
+                EXPECT_EQ(got.value(), want) << str;
+        }
+    }
+
+    env::Env vars;
+    vars.Set("x", 4);
+    std::istringstream in("x * x - 1");
+    EXPECT_EQ(stream::try_eval(in, &vars, 1).value(), 15);
+}
+
+TEST(STREAM, Errors) {
+    using expr::Errc;
+    struct Case {
+        const char *str;
+        Errc code;
+        uint64_t offset;
+    };
+    // the first error from the left
+    const Case cases[] = {
+        {"  ", Errc::EMPTY_STRING, 0},
+        {"()", Errc::EMPTY_EXPR, 0},
+        {"1 + (2", Errc::UNMATCHED_LPAR, 6},
+        {"1 ) + (", Errc::UNMATCHED_RPAR, 2},
+        {"1 + 2 +", Errc::UNFINISHED_EXPR, 6},
+        {"* 2", Errc::INCOMPLETE_EXPR, 0},
+        {"1 + * 2", Errc::DANGLING_OPR_OPI, 4},
+        {"1 2 #", Errc::DANGLING_NUM_OPL, 2},
+        {"1 # 2 3", Errc::UNKNOWN_OP, 2},
+        {"1 + .5", Errc::UNKNOWN_OP, 4},
+        {"1 + sinh 2", Errc::UNKNOWN_FN, 4},
+        {"min 1, 2", Errc::BAD_CALL, 4},
+        {"1 + max", Errc::BAD_CALL, 7},
+        {"(1, 2)", Errc::BAD_CALL, 2},
+        {"2 + max(5)", Errc::BAD_CALL, 9},
+    };
+    for (const auto &c : cases) {
+        std::istringstream in(c.str);
+        const auto r = stream::try_eval(in, nullptr, 1);
+        ASSERT_FALSE(r) << c.str;
+        EXPECT_EQ(r.error().code, c.code) << c.str;
+        EXPECT_EQ(r.error().offset, c.offset) << c.str;
+    }
+}
+
+TEST(STREAM, BoundedMemory) {
+    // a flat chain keeps at most three operands and two operators
+    stream::Evaluator ev;
+    const std::string term = "2 * 3 - ";
+    for (int i = 0; i < 100000; ++i)
+        ASSERT_TRUE(ev.Feed(term.data(), term.size()));
+    ASSERT_TRUE(ev.Feed("1", 1));
+    EXPECT_EQ(ev.Finish().value(), 6 - 6 * 99999 - 1);
+    EXPECT_LE(ev.Peak(), 5u);
+
+    // nesting keeps one operand and one operator per level
+    ev.Reset();
+    for (int i = 0; i < 20; ++i)
+        ASSERT_TRUE(ev.Feed("1 + (", 5));
+    ASSERT_TRUE(ev.Feed("1", 1));
+    for (int i = 0; i < 20; ++i)
+        ASSERT_TRUE(ev.Feed(")", 1));
+    EXPECT_EQ(ev.Finish().value(), 21);
+    EXPECT_LE(ev.Peak(), 2u * 21);
+}
+
+TEST(STREAM, FileDescriptor) {
+    std::FILE *f = std::tmpfile();
+    ASSERT_NE(f, nullptr);
+    std::fputs("(1 + 2) *\n 3!\n", f);
+    std::fflush(f);
+    std::rewind(f);
+    EXPECT_EQ(stream::try_eval(fileno(f), nullptr, 4).value(),
+              prog::eval("(1 + 2) * 3!"));
+    std::fclose(f);
+}
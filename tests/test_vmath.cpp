@@ -0,0 +1,137 @@
+#include "prog.hpp"
+#include "vmath.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace {
+
+    // Largest ULP distance of `out` from double precision libm rounded to
+    // float
+    template <typename R>
+    uint32_t max_ulp(const std::vector<float> &out, R &&ref,
+                     const std::vector<float> &x, const std::vector<float> &y) {
+        uint32_t worst = 0;
+        for (size_t i = 0; i < out.size(); ++i) {
+            const auto want = static_cast<float>(ref(x[i], y[i]));
+            worst = std::max(worst, vmath::ulp_diff(out[i], want));
+        }
+        return worst;
+    }
+
+    std::vector<float> sweep(std::mt19937 &gen, const size_t n, const float lo,
+                             const float hi) {
+        std::uniform_real_distribution<float> dist(lo, hi);
+        std::vector<float> v(n);
+        for (auto &f : v)
+            f = dist(gen);
+        return v;
+    }
+
+} // namespace
+
+TEST(VMATH, Accuracy) {
+    static constexpr size_t kN = 1 << 16;
+    std::mt19937 gen(29);
+
+    // log over the whole float range, plus around 1 where log is small
+    auto lx = sweep(gen, kN, -88, 88);
+    for (auto &f : lx)
+        f = std::exp(f);
+    const auto near1 = sweep(gen, kN, 0.9f, 1.1f);
+    lx.insert(lx.end(), near1.begin(), near1.end());
+    lx.insert(lx.end(), {0.0f, -1.0f, 1e-40f, INFINITY, NAN});
+
+    // pow with positive bases, and negative bases with integral exponents
+    auto px = sweep(gen, kN, 0, 50);
+    auto py = sweep(gen, kN, -20, 20);
+    for (size_t i = 0; i < kN / 4; ++i) {
+        px[i] = -px[i];
+        py[i] = std::round(py[i]);
+    }
+    px.insert(px.end(), {0.0f, -2.0f, 2.0f, 1.0f, INFINITY});
+    py.insert(py.end(), {-1.0f, 0.5f, 200.0f, NAN, -1.0f});
+    // subnormal and tiny bases
+    const auto tiny = sweep(gen, kN / 4, -149, -100);
+    const auto tiny_y = sweep(gen, kN / 4, -1.2f, 1.2f);
+    for (size_t i = 0; i < tiny.size(); ++i) {
+        px.push_back(std::exp2(std::round(tiny[i])) * (1 + tiny_y[i] / 8));
+        py.push_back(tiny_y[i]);
+    }
+    // results around overflow and into the subnormals, the exponents of
+    // negative bases rounded to integers
+    const auto big = sweep(gen, kN / 2, 1.01f, 50);
+    const auto big_t = sweep(gen, kN / 2, 120, 134);
+    for (size_t i = 0; i < big.size(); ++i) {
+        const float t = i % 2 == 0 ? big_t[i] : -big_t[i] - 16;
+        const float x = i % 3 == 0 ? -big[i] : big[i];
+        const float y = t / std::log2(big[i]);
+        px.push_back(x);
+        py.push_back(x < 0 ? std::round(y) : y);
+    }
+
+    // tgamma across the reflection range up to overflow, near the overflow
+    // cutoff (~35.04) and close to the poles at negative integers
+    auto gx = sweep(gen, kN, -10, 36);
+    gx.insert(gx.end(), {0.0f, -1.0f, 0.5f, 40.0f, 1000.0f});
+    const auto cutoff = sweep(gen, kN / 4, 34.5f, 35.5f);
+    gx.insert(gx.end(), cutoff.begin(), cutoff.end());
+    const auto poles = sweep(gen, kN / 4, -18, -4);
+    for (size_t i = 0; i < poles.size(); ++i) {
+        const float k = -static_cast<float>(1 + i % 10);
+        const float d = std::exp2(poles[i]);
+        gx.push_back(i % 2 == 0 ? k + d : k - d);
+    }
+
+    auto ref_log = [](float a, float) { return std::log(double(a)); };
+    auto ref_pow = [](float a, float b) {
+        return std::pow(double(a), double(b));
+    };
+    auto ref_gamma = [](float a, float) { return std::tgamma(double(a)); };
+
+    const std::pair<vmath::Accuracy, uint32_t> tiers[] = {
+        {vmath::Accuracy::ULP1, 1},
+        {vmath::Accuracy::ULP4, 4},
+    };
+    for (const auto &[acc, tol] : tiers) {
+        std::vector<float> out(lx.size());
+        vmath::log(lx.data(), out.data(), lx.size(), acc);
+        EXPECT_LE(max_ulp(out, ref_log, lx, lx), tol);
+
+        out.resize(px.size());
+        vmath::pow(px.data(), py.data(), out.data(), px.size(), acc);
+        EXPECT_LE(max_ulp(out, ref_pow, px, py), tol);
+
+        out.resize(gx.size());
+        vmath::tgamma(gx.data(), out.data(), gx.size(), acc);
+        EXPECT_LE(max_ulp(out, ref_gamma, gx, gx), tol);
+    }
+}
+
+TEST(VMATH, BatchMatchesRun) {
+    const char *strs[] = {
+        "3! - ln(5-1) + 7 / 3^2",  "-2^2 + 3!!",        "2 * ln 4 ^ 2",
+        "(1 + 2) * (3 + 4) / 5!", "pi",                "4.5! - ln e",
+        "2^(3+1)^2 - 6*(7 + 1)/4",
+    };
+    std::vector<prog::Program> progs;
+    std::vector<prog::View> views;
+    for (const char *s : strs)
+        progs.push_back(prog::compile(s));
+    for (const auto &p : progs)
+        views.push_back(p.view());
+
+    std::vector<float> out(views.size());
+    prog::run_batch(views, out.data(), vmath::Accuracy::EXACT);
+    for (size_t i = 0; i < views.size(); ++i)
+        EXPECT_EQ(vmath::ulp_diff(out[i], prog::run(views[i])), 0u)
+            << strs[i];
+
+    const vmath::ScopedAccuracy guard(vmath::Accuracy::ULP4);
+    prog::run_batch(views, out.data());
+    for (size_t i = 0; i < views.size(); ++i)
+        EXPECT_LE(vmath::ulp_diff(out[i], prog::run(views[i])), 16u)
+            << strs[i];
+    EXPECT_EQ(vmath::get_accuracy(), vmath::Accuracy::ULP4);
+}
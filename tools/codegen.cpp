@@ -0,0 +1,22 @@
+// scicalc_codegen: compile a formula file into a C++ header
+#include <iostream>
+
+#include "codegen.hpp"
+
+int main(int argc, char **argv) {
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <formulas> <header> [namespace]\n"
+                  << "  one `name(a, b) = expr` per line, compiled into inline "
+                     "functions in\n"
+                  << "  `namespace` (default `formulas`)\n";
+        return 2;
+    }
+    try {
+        codegen::generate(argv[1], argv[2], argc == 4 ? argv[3] : "formulas");
+    } catch (std::exception &ex) {
+        std::cerr << "Error: " << argv[1] << ": " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
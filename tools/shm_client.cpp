@@ -0,0 +1,75 @@
+// scicalc_shm_client: evaluate stdin, one expression per line, through a
+// running `scicalc serve-shm`
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <string>
+
+#include "shm.hpp"
+
+namespace {
+
+    void print(const std::string &expr, const shm::Response &r) {
+        if (r.code == expr::Errc::OK)
+            std::cout << expr << " = " << r.value << "\n";
+        else
+            std::cout << expr << " : error " << static_cast<int>(r.code)
+                      << " at column " << r.offset + 1 << "\n";
+    }
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2 && argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <name> [spin|futex]\n"
+                  << "  evaluate stdin, one expression per line, on the "
+                     "server started by\n"
+                  << "  `scicalc serve-shm <name>`\n";
+        return 2;
+    }
+    const std::string mode = argc == 3 ? argv[2] : "futex";
+    if (mode != "spin" && mode != "futex") {
+        std::cerr << "Error: Unknown wait mode: " << mode << std::endl;
+        return 2;
+    }
+    const shm::Wait w = mode == "spin" ? shm::Wait::SPIN : shm::Wait::FUTEX;
+
+    try {
+        shm::Channel ch = shm::Channel::Open(argv[1]);
+        // requests in flight, answered in order
+        std::deque<std::string> sent;
+        shm::Response r;
+        uint64_t n = 0;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (std::string line; std::getline(std::cin, line);) {
+            if (line.size() > shm::kMaxText) {
+                std::cout << line.substr(0, 16) << "... : too long\n";
+                continue;
+            }
+            // keep the pipeline full, draining what came back meanwhile
+            while (sent.size() == ch.Slots() || ch.TryRecv(r)) {
+                if (sent.size() == ch.Slots())
+                    ch.Recv(r, w);
+                print(sent.front(), r);
+                sent.pop_front();
+            }
+            ch.Send(n++, line, w);
+            sent.push_back(std::move(line));
+        }
+        for (; !sent.empty(); sent.pop_front()) {
+            ch.Recv(r, w);
+            print(sent.front(), r);
+        }
+        ch.Close();
+
+        const std::chrono::duration<double> d =
+            std::chrono::steady_clock::now() - t0;
+        std::cerr << n << " expressions in " << d.count() << " s ("
+                  << static_cast<uint64_t>(n / d.count()) << " msgs/s)"
+                  << std::endl;
+    } catch (std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}